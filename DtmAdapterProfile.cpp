@@ -0,0 +1,339 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmAdapterProfile.cpp
+**
+** Notes: Measures the latency, jitter, throughput and modem line latency of
+**        a USB-serial adapter through a loopback plug (TX-RX, RTS-CTS) and
+**        stores the result as a per-adapter profile
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include "DtmAdapterProfile.h"
+#include "DtmConstants.h"
+#include <QElapsedTimer>
+#include <QThread>
+#include <math.h>
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+QString
+DtmAdapterProfiler::AdapterKey(
+    const QString &strPort
+    )
+{
+    //Identifies the adapter by USB IDs and serial number where possible so the profile follows it between ports
+    QSerialPortInfo spiSerialInfo(strPort);
+    QString strKey;
+    if (spiSerialInfo.isValid() && spiSerialInfo.hasVendorIdentifier() && spiSerialInfo.hasProductIdentifier())
+    {
+        strKey = QString("%1_%2").arg(spiSerialInfo.vendorIdentifier(), 4, 16, QChar('0')).arg(spiSerialInfo.productIdentifier(), 4, 16, QChar('0'));
+        if (spiSerialInfo.serialNumber().length() > 0)
+        {
+            strKey.append("_").append(spiSerialInfo.serialNumber());
+        }
+    }
+    else
+    {
+        strKey = strPort;
+    }
+
+    //Settings keys cannot contain path separators
+    return strKey.replace("/", "_").replace("\\", "_");
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmAdapterProfiler::Load(
+    QSettings *pSettings,
+    const QString &strKey,
+    DtmAdapterProfile *pProfile
+    )
+{
+    //Reads a stored profile, returns false if the adapter has not been characterised
+    pSettings->beginGroup(QString("Adapters/").append(strKey));
+    bool bFound = pSettings->contains("RoundTrip");
+    if (bFound == true)
+    {
+        pProfile->strKey = strKey;
+        pProfile->dblRoundTrip = pSettings->value("RoundTrip").toDouble();
+        pProfile->dblJitter = pSettings->value("Jitter").toDouble();
+        pProfile->dblRoundTripMin = pSettings->value("RoundTripMin").toDouble();
+        pProfile->dblRoundTripMax = pSettings->value("RoundTripMax").toDouble();
+        pProfile->dblThroughputDTM = pSettings->value("ThroughputDTM").toDouble();
+        pProfile->dblThroughputUser = pSettings->value("ThroughputUser").toDouble();
+        pProfile->intUserBaud = pSettings->value("UserBaud").toInt();
+        pProfile->dblCTSLatency = pSettings->value("CTSLatency", -1).toDouble();
+    }
+    pSettings->endGroup();
+
+    return bFound;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmAdapterProfiler::Save(
+    QSettings *pSettings,
+    const DtmAdapterProfile &dapProfile
+    )
+{
+    //Stores a profile for use by later escapes
+    pSettings->beginGroup(QString("Adapters/").append(dapProfile.strKey));
+    pSettings->setValue("RoundTrip", dapProfile.dblRoundTrip);
+    pSettings->setValue("Jitter", dapProfile.dblJitter);
+    pSettings->setValue("RoundTripMin", dapProfile.dblRoundTripMin);
+    pSettings->setValue("RoundTripMax", dapProfile.dblRoundTripMax);
+    pSettings->setValue("ThroughputDTM", dapProfile.dblThroughputDTM);
+    pSettings->setValue("ThroughputUser", dapProfile.dblThroughputUser);
+    pSettings->setValue("UserBaud", dapProfile.intUserBaud);
+    pSettings->setValue("CTSLatency", dapProfile.dblCTSLatency);
+    pSettings->endGroup();
+}
+
+//=============================================================================
+//=============================================================================
+QString
+DtmAdapterProfiler::Describe(
+    const DtmAdapterProfile &dapProfile
+    )
+{
+    //Returns a one line summary of a profile
+    QString strSummary = QString("round trip %1 ms (jitter %2, min %3, max %4), %5 baud: %6 B/s (%7%), %8 baud: %9 B/s (%10%), CTS: ")
+        .arg(dapProfile.dblRoundTrip, 0, 'f', 2).arg(dapProfile.dblJitter, 0, 'f', 2).arg(dapProfile.dblRoundTripMin, 0, 'f', 2).arg(dapProfile.dblRoundTripMax, 0, 'f', 2)
+        .arg(DTMBaudRate).arg(dapProfile.dblThroughputDTM, 0, 'f', 0).arg(dapProfile.dblThroughputDTM*1000.0/(double)DTMBaudRate, 0, 'f', 0)
+        .arg(dapProfile.intUserBaud).arg(dapProfile.dblThroughputUser, 0, 'f', 0).arg((dapProfile.intUserBaud > 0 ? dapProfile.dblThroughputUser*1000.0/dapProfile.intUserBaud : 0), 0, 'f', 0);
+    if (dapProfile.dblCTSLatency < 0)
+    {
+        strSummary.append("not looped back");
+    }
+    else
+    {
+        strSummary.append(QString::number(dapProfile.dblCTSLatency, 'f', 2)).append(" ms");
+    }
+    return strSummary;
+}
+
+//=============================================================================
+//=============================================================================
+quint16
+DtmAdapterProfiler::ResponseTimeout(
+    const DtmAdapterProfile &dapProfile,
+    quint16 intDefault
+    )
+{
+    //Time to wait for a short command response on this adapter, never longer than the default
+    double dblTimeout = dapProfile.dblRoundTrip*2.0 + dapProfile.dblJitter*4.0 + ProfileTimeoutMargin;
+    if (dblTimeout < dapProfile.dblRoundTripMax + ProfileTimeoutMargin)
+    {
+        dblTimeout = dapProfile.dblRoundTripMax + ProfileTimeoutMargin;
+    }
+    return (quint16)qBound((double)ProfileMinTimeout, ceil(dblTimeout), (double)intDefault);
+}
+
+//=============================================================================
+//=============================================================================
+quint16
+DtmAdapterProfiler::PollInterval(
+    const DtmAdapterProfile &dapProfile
+    )
+{
+    //Modem line poll interval, shorter on adapters which report CTS changes quickly
+    if (dapProfile.dblCTSLatency < 0)
+    {
+        return ProfileMaxPollInterval;
+    }
+    return (quint16)qBound((double)ProfileMinPollInterval, ceil(dapProfile.dblCTSLatency*2.0), (double)ProfileMaxPollInterval);
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmAdapterProfiler::Characterise(
+    const QString &strPort,
+    qint32 intUserBaud,
+    DtmAdapterProfile *pProfile,
+    QString *pstrError
+    )
+{
+    //Runs all measurements on a port which has a loopback plug (or PTY echo) attached
+    QSerialPort spPort;
+    spPort.setPortName(strPort);
+    spPort.setBaudRate(DTMBaudRate);
+    spPort.setDataBits(QSerialPort::Data8);
+    spPort.setStopBits(QSerialPort::OneStop);
+    spPort.setParity(QSerialPort::NoParity);
+    spPort.setFlowControl(QSerialPort::NoFlowControl);
+    if (!spPort.open(QIODevice::ReadWrite))
+    {
+        *pstrError = spPort.errorString();
+        return false;
+    }
+
+    pProfile->strKey = AdapterKey(strPort);
+    pProfile->intUserBaud = intUserBaud;
+    if (MeasureRoundTrip(&spPort, pProfile) == false)
+    {
+        *pstrError = "No loopback detected";
+        spPort.close();
+        return false;
+    }
+
+    pProfile->dblThroughputDTM = MeasureThroughput(&spPort);
+    if (spPort.setBaudRate(intUserBaud) == true)
+    {
+        pProfile->dblThroughputUser = MeasureThroughput(&spPort);
+    }
+    else
+    {
+        pProfile->dblThroughputUser = 0;
+    }
+    pProfile->dblCTSLatency = MeasureCTSLatency(&spPort);
+    spPort.close();
+
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmAdapterProfiler::MeasureRoundTrip(
+    QSerialPort *pPort,
+    DtmAdapterProfile *pProfile
+    )
+{
+    //Times single bytes through the loopback
+    QElapsedTimer tmrRoundTrip;
+    double dblSum = 0;
+    double dblSumSquares = 0;
+    pProfile->dblRoundTripMin = 0;
+    pProfile->dblRoundTripMax = 0;
+
+    quint8 i = 0;
+    while (i < ProfileRoundTripSamples)
+    {
+        pPort->clear();
+        tmrRoundTrip.start();
+        pPort->write("U");
+        while (pPort->bytesAvailable() < 1)
+        {
+            if (pPort->waitForReadyRead(ProfileReadTimeout) == false)
+            {
+                //Byte never came back
+                return false;
+            }
+        }
+        double dblTime = tmrRoundTrip.nsecsElapsed()/1000000.0;
+        pPort->readAll();
+
+        dblSum += dblTime;
+        dblSumSquares += dblTime*dblTime;
+        if (i == 0 || dblTime < pProfile->dblRoundTripMin)
+        {
+            pProfile->dblRoundTripMin = dblTime;
+        }
+        if (dblTime > pProfile->dblRoundTripMax)
+        {
+            pProfile->dblRoundTripMax = dblTime;
+        }
+        ++i;
+    }
+
+    pProfile->dblRoundTrip = dblSum/ProfileRoundTripSamples;
+    double dblVariance = dblSumSquares/ProfileRoundTripSamples - pProfile->dblRoundTrip*pProfile->dblRoundTrip;
+    pProfile->dblJitter = (dblVariance > 0 ? sqrt(dblVariance) : 0);
+
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+double
+DtmAdapterProfiler::MeasureThroughput(
+    QSerialPort *pPort
+    )
+{
+    //Sends a block sized to take a fixed time at line rate and times it coming back
+    qint64 intBlockSize = (qint64)pPort->baudRate()/10*ProfileThroughputTime/1000;
+    intBlockSize = qBound((qint64)64, intBlockSize, (qint64)65536);
+    QByteArray baBlock((int)intBlockSize, 'U');
+    QElapsedTimer tmrThroughput;
+    qint64 intReceived = 0;
+
+    pPort->clear();
+    tmrThroughput.start();
+    pPort->write(baBlock);
+    while (intReceived < intBlockSize)
+    {
+        if (pPort->waitForReadyRead(ProfileReadTimeout) == false)
+        {
+            //Data stopped coming back
+            break;
+        }
+        intReceived += pPort->readAll().length();
+    }
+
+    qint64 intElapsed = tmrThroughput.nsecsElapsed();
+    return (intElapsed > 0 ? intReceived*1000000000.0/intElapsed : 0);
+}
+
+//=============================================================================
+//=============================================================================
+double
+DtmAdapterProfiler::MeasureCTSLatency(
+    QSerialPort *pPort
+    )
+{
+    //Toggles RTS and times how long CTS takes to follow, returns -1 if it never does
+    QElapsedTimer tmrCTS;
+    double dblSum = 0;
+    bool bRTS = ((pPort->pinoutSignals() & QSerialPort::RequestToSendSignal) == QSerialPort::RequestToSendSignal);
+
+    quint8 i = 0;
+    while (i < ProfileCTSSamples)
+    {
+        bRTS = !bRTS;
+        tmrCTS.start();
+        if (pPort->setRequestToSend(bRTS) == false)
+        {
+            //Modem lines not supported (e.g. a PTY)
+            return -1;
+        }
+        while (((pPort->pinoutSignals() & QSerialPort::ClearToSendSignal) == QSerialPort::ClearToSendSignal) != bRTS)
+        {
+            if (tmrCTS.elapsed() > ProfileReadTimeout)
+            {
+                //CTS is not looped back to RTS
+                return -1;
+            }
+            QThread::usleep(100);
+        }
+        dblSum += tmrCTS.nsecsElapsed()/1000000.0;
+        ++i;
+    }
+
+    return dblSum/ProfileCTSSamples;
+}
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
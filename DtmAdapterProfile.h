@@ -0,0 +1,126 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmAdapterProfile.h
+**
+** Notes: Measures the latency, jitter, throughput and modem line latency of
+**        a USB-serial adapter through a loopback plug (TX-RX, RTS-CTS) and
+**        stores the result as a per-adapter profile
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMADAPTERPROFILE_H
+#define DTMADAPTERPROFILE_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QSerialPort>
+#include <QSerialPortInfo>
+#include <QSettings>
+#include <QString>
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+const quint8                   ProfileRoundTripSamples    = 32; //Number of single byte round trips measured
+const quint8                   ProfileCTSSamples          = 8; //Number of RTS toggles measured
+const quint16                  ProfileReadTimeout         = 500; //Time (in ms) to wait for a looped back byte or CTS change
+const quint16                  ProfileThroughputTime      = 250; //Approximate time (in ms) at line rate of each throughput block
+const quint16                  ProfileMinTimeout          = 50; //Shortest response timeout (in ms) a profile can set
+const quint16                  ProfileTimeoutMargin       = 30; //Time (in ms) added to measured latency for the module to respond
+const quint16                  ProfileMinPollInterval     = 10; //Shortest modem line poll interval (in ms) a profile can set
+const quint16                  ProfileMaxPollInterval     = 100; //Longest modem line poll interval (in ms), the default
+
+/******************************************************************************/
+// Structures
+/******************************************************************************/
+struct DtmAdapterProfile
+{
+    QString strKey; //Adapter identifier (VID:PID:serial or port name)
+    double dblRoundTrip; //Mean single byte round trip (in ms)
+    double dblJitter; //Standard deviation of the round trip (in ms)
+    double dblRoundTripMin; //Fastest round trip (in ms)
+    double dblRoundTripMax; //Slowest round trip (in ms)
+    double dblThroughputDTM; //Looped back throughput at the DTM baud rate (in bytes/s)
+    double dblThroughputUser; //Looped back throughput at the interactive baud rate (in bytes/s)
+    qint32 intUserBaud; //Interactive baud rate the throughput was measured at
+    double dblCTSLatency; //Mean time from RTS change to CTS change (in ms), negative if not wired
+};
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+class DtmAdapterProfiler
+{
+public:
+    static QString
+    AdapterKey(
+        const QString &strPort
+        );
+    static bool
+    Load(
+        QSettings *pSettings,
+        const QString &strKey,
+        DtmAdapterProfile *pProfile
+        );
+    static void
+    Save(
+        QSettings *pSettings,
+        const DtmAdapterProfile &dapProfile
+        );
+    static QString
+    Describe(
+        const DtmAdapterProfile &dapProfile
+        );
+    static quint16
+    ResponseTimeout(
+        const DtmAdapterProfile &dapProfile,
+        quint16 intDefault
+        );
+    static quint16
+    PollInterval(
+        const DtmAdapterProfile &dapProfile
+        );
+    bool
+    Characterise(
+        const QString &strPort,
+        qint32 intUserBaud,
+        DtmAdapterProfile *pProfile,
+        QString *pstrError
+        );
+
+private:
+    bool
+    MeasureRoundTrip(
+        QSerialPort *pPort,
+        DtmAdapterProfile *pProfile
+        );
+    double
+    MeasureThroughput(
+        QSerialPort *pPort
+        );
+    double
+    MeasureCTSLatency(
+        QSerialPort *pPort
+        );
+};
+
+#endif // DTMADAPTERPROFILE_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
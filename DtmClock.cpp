@@ -0,0 +1,268 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmClock.cpp
+**
+** Notes: Clock and timers used by the escape state machine. Normally these
+**        follow the wall clock, in virtual time the timers fire in deadline
+**        order as fast as possible so timeouts cost no real time.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include "DtmClock.h"
+
+/******************************************************************************/
+// Static Members
+/******************************************************************************/
+bool DtmClock::gbVirtual = false;
+qint64 DtmClock::gintVirtualNow = 0;
+QElapsedTimer DtmClock::gtmrReal;
+QList<DtmTimer *> DtmClock::glstPending;
+bool DtmClock::gbRunQueued = false;
+quint64 DtmClock::gintSequence = 0;
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+void
+DtmClock::SetVirtual(
+    bool bVirtual
+    )
+{
+    //Must be set before any timer is started
+    gbVirtual = bVirtual;
+    gintVirtualNow = 0;
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmClock::IsVirtual(
+    )
+{
+    return gbVirtual;
+}
+
+//=============================================================================
+//=============================================================================
+qint64
+DtmClock::Now(
+    )
+{
+    //Returns the current time (in ns)
+    if (gbVirtual == true)
+    {
+        return gintVirtualNow;
+    }
+    if (gtmrReal.isValid() == false)
+    {
+        gtmrReal.start();
+    }
+    return gtmrReal.nsecsElapsed();
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmClock::Schedule(
+    DtmTimer *pTimer
+    )
+{
+    //Adds a timer to the virtual queue, the queue is run from the event loop
+    Cancel(pTimer);
+    pTimer->gbVirtualActive = true;
+    pTimer->gintDeadline = gintVirtualNow + (qint64)pTimer->gtmrTimer.interval()*1000000;
+    pTimer->gintSequence = gintSequence++;
+    glstPending.append(pTimer);
+    if (gbRunQueued == false)
+    {
+        gbRunQueued = true;
+        QTimer::singleShot(0, &DtmClock::Run);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmClock::Cancel(
+    DtmTimer *pTimer
+    )
+{
+    //Removes a timer from the virtual queue
+    pTimer->gbVirtualActive = false;
+    glstPending.removeAll(pTimer);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmClock::Run(
+    )
+{
+    //Fires timers in deadline order, jumping the clock to each deadline. Repeating timers
+    //alone do not move the state machine on, so stop once only those are left
+    quint32 intEvents = 0;
+    while (intEvents < ClockMaxVirtualEvents)
+    {
+        DtmTimer *pNext = NULL;
+        bool bSingleShot = false;
+        int i = 0;
+        while (i < glstPending.count())
+        {
+            DtmTimer *pTimer = glstPending[i];
+            if (pNext == NULL || pTimer->gintDeadline < pNext->gintDeadline || (pTimer->gintDeadline == pNext->gintDeadline && pTimer->gintSequence < pNext->gintSequence))
+            {
+                pNext = pTimer;
+            }
+            if (pTimer->gtmrTimer.isSingleShot() == true)
+            {
+                bSingleShot = true;
+            }
+            ++i;
+        }
+        if (pNext == NULL || bSingleShot == false)
+        {
+            break;
+        }
+
+        gintVirtualNow = pNext->gintDeadline;
+        if (pNext->gtmrTimer.isSingleShot() == true)
+        {
+            Cancel(pNext);
+        }
+        else
+        {
+            Schedule(pNext);
+        }
+        emit pNext->timeout();
+        ++intEvents;
+    }
+    gbRunQueued = false;
+}
+
+//=============================================================================
+//=============================================================================
+DtmTimer::DtmTimer(
+    QObject *parent
+    ) : QObject(parent)
+{
+    gbVirtualActive = false;
+    gintDeadline = 0;
+    gintSequence = 0;
+    connect(&gtmrTimer, SIGNAL(timeout()), this, SIGNAL(timeout()));
+}
+
+//=============================================================================
+//=============================================================================
+DtmTimer::~DtmTimer(
+    )
+{
+    DtmClock::Cancel(this);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmTimer::setSingleShot(
+    bool bSingleShot
+    )
+{
+    gtmrTimer.setSingleShot(bSingleShot);
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmTimer::isSingleShot(
+    ) const
+{
+    return gtmrTimer.isSingleShot();
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmTimer::setInterval(
+    int intInterval
+    )
+{
+    gtmrTimer.setInterval(intInterval);
+}
+
+//=============================================================================
+//=============================================================================
+int
+DtmTimer::interval(
+    ) const
+{
+    return gtmrTimer.interval();
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmTimer::isActive(
+    ) const
+{
+    return (gbVirtualActive == true || gtmrTimer.isActive() == true);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmTimer::start(
+    )
+{
+    //(Re)starts the timer with the current interval
+    if (DtmClock::IsVirtual() == true)
+    {
+        DtmClock::Schedule(this);
+    }
+    else
+    {
+        gtmrTimer.start();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmTimer::start(
+    int intInterval
+    )
+{
+    gtmrTimer.setInterval(intInterval);
+    start();
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmTimer::stop(
+    )
+{
+    //Stops the timer in both clocks, in case it was started before virtual time was enabled
+    DtmClock::Cancel(this);
+    gtmrTimer.stop();
+}
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
@@ -0,0 +1,182 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmClock.h
+**
+** Notes: Clock and timers used by the escape state machine. Normally these
+**        follow the wall clock, in virtual time the timers fire in deadline
+**        order as fast as possible so timeouts cost no real time.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMCLOCK_H
+#define DTMCLOCK_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QObject>
+#include <QTimer>
+#include <QList>
+#include <QElapsedTimer>
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+const quint32                  ClockMaxVirtualEvents      = 10000000; //Timer events run in virtual time before giving up (guards against loops)
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+class DtmTimer;
+
+class DtmClock
+{
+public:
+    static void
+    SetVirtual(
+        bool bVirtual
+        );
+    static bool
+    IsVirtual(
+        );
+    static qint64
+    Now(
+        );
+
+private:
+    friend class DtmTimer;
+    static void
+    Schedule(
+        DtmTimer *pTimer
+        );
+    static void
+    Cancel(
+        DtmTimer *pTimer
+        );
+    static void
+    Run(
+        );
+
+    static bool gbVirtual; //True when time only moves forward as timers fire
+    static qint64 gintVirtualNow; //Current virtual time (in ns)
+    static QElapsedTimer gtmrReal; //Wall clock used when not virtual
+    static QList<DtmTimer *> glstPending; //Active timers in virtual time
+    static bool gbRunQueued; //True once the event loop has been asked to run the pending timers
+    static quint64 gintSequence; //Orders timers with the same deadline by when they were started
+};
+
+class DtmTimer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DtmTimer(
+        QObject *parent = 0
+        );
+    ~DtmTimer(
+        );
+    void
+    setSingleShot(
+        bool bSingleShot
+        );
+    bool
+    isSingleShot(
+        ) const;
+    void
+    setInterval(
+        int intInterval
+        );
+    int
+    interval(
+        ) const;
+    bool
+    isActive(
+        ) const;
+
+public slots:
+    void
+    start(
+        );
+    void
+    start(
+        int intInterval
+        );
+    void
+    stop(
+        );
+
+signals:
+    void
+    timeout(
+        );
+
+private:
+    friend class DtmClock;
+    QTimer gtmrTimer; //Wall clock timer
+    bool gbVirtualActive; //True whilst scheduled in virtual time
+    qint64 gintDeadline; //Virtual time (in ns) the timer fires at
+    quint64 gintSequence; //Order the timer was started in
+};
+
+class DtmStopwatch
+{
+public:
+    inline DtmStopwatch(
+        )
+    {
+        gintStart = -1;
+    }
+    inline void
+    start(
+        )
+    {
+        gintStart = DtmClock::Now();
+    }
+    inline void
+    invalidate(
+        )
+    {
+        gintStart = -1;
+    }
+    inline bool
+    isValid(
+        ) const
+    {
+        return (gintStart >= 0);
+    }
+    inline qint64
+    nsecsElapsed(
+        ) const
+    {
+        return (gintStart >= 0 ? DtmClock::Now() - gintStart : 0);
+    }
+    inline qint64
+    elapsed(
+        ) const
+    {
+        return nsecsElapsed()/1000000;
+    }
+
+private:
+    qint64 gintStart; //Time (in ns) the stopwatch was started, negative if not started
+};
+
+#endif // DTMCLOCK_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
@@ -0,0 +1,86 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmConstants.h
+**
+** Notes: Module commands, timeouts, program states and exit codes shared by
+**        the window and the helper modules, so the helpers do not need the
+**        window class
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMCONSTANTS_H
+#define DTMCONSTANTS_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QSerialPort>
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+//Constants for timeouts and streaming
+const qint16                   ModuleTimeout              = 14000; //Time (in ms) until a part of the process is considered timed out
+
+//Constants for program state
+const quint8                   ProgramStatusIdle          = 0;
+const quint8                   ProgramStatusExitDTM       = 1;
+const quint8                   ProgramStatusEraseFS       = 2;
+const quint8                   ProgramStatusLicenseCheck  = 3;
+const quint8                   ProgramStatus              = 4;
+const quint8                   ProgramStatusBaudDetect    = 5;
+const quint8                   ProgramStatusProbe         = 6;
+const quint8                   ProgramStatusLicenseInstall = 7;
+const quint8                   ProgramStatusHighSpeed     = 8;
+const quint8                   ProgramStatusIdentify      = 9;
+
+//Command codes used to exit DTM mode and DTM options
+const quint8                   DTMExitCMDA                = 0x3f;
+const quint8                   DTMExitCMDB                = 0xff;
+const QSerialPort::BaudRate    DTMBaudRate                = QSerialPort::Baud19200;
+const QSerialPort::FlowControl DTMFlowControl             = QSerialPort::NoFlowControl;
+
+//Constants for resending the exit DTM command
+const quint16                  DTMRetryInitialInterval    = 100; //Time (in ms) until the exit DTM command is first resent
+const quint16                  DTMRetryMinInterval        = 10; //Shortest allowed resend interval (in ms)
+const quint16                  DTMRetryMaxInterval        = 1600; //Upper bound (in ms) of the exponential backoff between resends
+const quint8                   DTMRetryDefaultAttempts    = 0; //Number of resends by default (0 = send once only)
+const quint8                   DTMRetryMaxAttempts        = 254; //Largest number of resends (the attempt counter must not wrap)
+const quint16                  DTMResetPulseTime          = 20; //Time (in ms) the reset line is asserted for before a resend
+
+//Constants for the identity check before erasing
+const quint16                  IdentifyProbeTimeout       = 500; //Time (in ms) to wait for the firmware and device type responses
+const char                     IdentifyFirmwareQuery[]    = "at i 3"; //Query returning the firmware version
+const char                     IdentifyTypeQuery[]        = "at i 0"; //Query returning the device type
+
+//Exit code results
+const int                      ExitCodeOK                 = 0;
+const int                      ExitCodeInvalidPort        = -1;
+const int                      ExitCodeCTSAsserted        = -2;
+const int                      ExitCodeLicenseMissing     = -3;
+const int                      ExitCodeTimeout            = -4;
+const int                      ExitCodeSerialPortError    = -5;
+const int                      ExitCodeInvalidTrace       = -6;
+const int                      ExitCodeWorkerCrashed      = -7; //Supervisor only: worker kept crashing
+const int                      ExitCodeQuarantined        = -8; //Port quarantined for drifting stage times
+const int                      ExitCodeIdentityMismatch   = -9; //Firmware or device type not in the allow-list
+
+#endif // DTMCONSTANTS_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
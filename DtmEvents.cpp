@@ -0,0 +1,168 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmEvents.cpp
+**
+** Notes: Optional progress event stream. Each event is one line of JSON
+**        on stdout (NDJSON), written and flushed as it happens so other
+**        tools can follow every port without waiting for the exit code.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include "DtmEvents.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <stdio.h>
+
+/******************************************************************************/
+// Static Members
+/******************************************************************************/
+bool DtmEvent::gbEnabled = false;
+QByteArray DtmEvent::gbaPort;
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+void
+DtmEvent::Enable(
+    const QString &strPort
+    )
+{
+    //Starts the stream, events name the port they are from
+    gbaPort = Quote(strPort.toUtf8());
+    gbEnabled = true;
+}
+
+//=============================================================================
+//=============================================================================
+QByteArray
+DtmEvent::Quote(
+    const QByteArray &baValue
+    )
+{
+    //Returns the value as a JSON string
+    static const char strHexDigits[] = "0123456789abcdef";
+    QByteArray baQuoted;
+    baQuoted.reserve(baValue.length() + 2);
+    baQuoted.append('"');
+    int i = 0;
+    while (i < baValue.length())
+    {
+        unsigned char chData = (unsigned char)baValue.at(i);
+        if (chData == '"' || chData == '\\')
+        {
+            baQuoted.append('\\').append((char)chData);
+        }
+        else if (chData < 0x20)
+        {
+            baQuoted.append("\\u00").append(strHexDigits[chData >> 4]).append(strHexDigits[chData & 0x0f]);
+        }
+        else
+        {
+            baQuoted.append((char)chData);
+        }
+        ++i;
+    }
+    baQuoted.append('"');
+    return baQuoted;
+}
+
+//=============================================================================
+//=============================================================================
+DtmEvent::DtmEvent(
+    const char *pEvent,
+    const QString &strPort
+    )
+{
+    //Every event starts with its type, the time (in ms since the epoch), the port (the enabled one
+    //unless given) and the process
+    gbaLine.reserve(256);
+    gbaLine.append("{\"event\":\"").append(pEvent).append("\",\"time\":").append(QByteArray::number(QDateTime::currentMSecsSinceEpoch()));
+    gbaLine.append(",\"port\":").append(strPort.length() > 0 ? Quote(strPort.toUtf8()) : gbaPort).append(",\"pid\":").append(QByteArray::number(QCoreApplication::applicationPid()));
+}
+
+//=============================================================================
+//=============================================================================
+DtmEvent &
+DtmEvent::Add(
+    const char *pKey,
+    const QString &strValue
+    )
+{
+    gbaLine.append(",\"").append(pKey).append("\":").append(Quote(strValue.toUtf8()));
+    return *this;
+}
+
+//=============================================================================
+//=============================================================================
+DtmEvent &
+DtmEvent::Add(
+    const char *pKey,
+    const char *pValue
+    )
+{
+    gbaLine.append(",\"").append(pKey).append("\":").append(pValue == NULL ? QByteArray("null") : Quote(QByteArray(pValue)));
+    return *this;
+}
+
+//=============================================================================
+//=============================================================================
+DtmEvent &
+DtmEvent::Add(
+    const char *pKey,
+    qint64 intValue
+    )
+{
+    gbaLine.append(",\"").append(pKey).append("\":").append(QByteArray::number(intValue));
+    return *this;
+}
+
+//=============================================================================
+//=============================================================================
+DtmEvent &
+DtmEvent::Add(
+    const char *pKey,
+    bool bValue
+    )
+{
+    gbaLine.append(",\"").append(pKey).append("\":").append(bValue == true ? "true" : "false");
+    return *this;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmEvent::Emit(
+    )
+{
+    //Writes the event as one line in a single call and flushes it, so lines from workers sharing
+    //the supervisor's stdout do not interleave
+    if (gbEnabled == false)
+    {
+        return;
+    }
+    gbaLine.append("}\n");
+    fwrite(gbaLine.constData(), 1, gbaLine.length(), stdout);
+    fflush(stdout);
+}
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
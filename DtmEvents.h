@@ -0,0 +1,93 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmEvents.h
+**
+** Notes: Optional progress event stream. Each event is one line of JSON
+**        on stdout (NDJSON), written and flushed as it happens so other
+**        tools can follow every port without waiting for the exit code.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMEVENTS_H
+#define DTMEVENTS_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QString>
+#include <QByteArray>
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+class DtmEvent
+{
+public:
+    static void
+    Enable(
+        const QString &strPort
+        );
+    static inline bool
+    IsEnabled(
+        )
+    {
+        return gbEnabled;
+    }
+    explicit DtmEvent(
+        const char *pEvent,
+        const QString &strPort = QString()
+        );
+    DtmEvent &
+    Add(
+        const char *pKey,
+        const QString &strValue
+        );
+    DtmEvent &
+    Add(
+        const char *pKey,
+        const char *pValue
+        );
+    DtmEvent &
+    Add(
+        const char *pKey,
+        qint64 intValue
+        );
+    DtmEvent &
+    Add(
+        const char *pKey,
+        bool bValue
+        );
+    void
+    Emit(
+        );
+
+private:
+    static QByteArray
+    Quote(
+        const QByteArray &baValue
+        );
+
+    static bool gbEnabled; //True once enabled, events are discarded otherwise
+    static QByteArray gbaPort; //Quoted port name added to every event
+    QByteArray gbaLine; //Event being built
+};
+
+#endif // DTMEVENTS_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
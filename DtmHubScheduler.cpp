@@ -0,0 +1,323 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmHubScheduler.cpp
+**
+** Notes: Limits how many ExitDTM instances escape modules behind the same
+**        USB hub at once and staggers their port openings. Slots are lock
+**        files shared between processes, the limit per hub adapts to the
+**        results of previous escapes.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include "DtmHubScheduler.h"
+#include "DtmConstants.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QRegularExpression>
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+DtmHubScheduler::DtmHubScheduler(
+    )
+{
+    gpSettings = NULL;
+    gstrHub = HubDefaultName;
+    gplfSlot = NULL;
+    gplfOpening = NULL;
+    gbReleasePending = false;
+    gintReleaseCode = 0;
+    gintReleaseTime = 0;
+    gintReleaseAttempts = 0;
+}
+
+//=============================================================================
+//=============================================================================
+DtmHubScheduler::~DtmHubScheduler(
+    )
+{
+    Unlock();
+}
+
+//=============================================================================
+//=============================================================================
+QString
+DtmHubScheduler::HubForPort(
+    const QString &strPort
+    )
+{
+    //Finds the USB hub a serial port is connected through
+#ifdef __linux__
+    //sysfs path is .../usbN/<hub>/<device>/<device>:<config>.<interface>[/ttyUSBn]
+    QString strDevice = QFileInfo(QString("/sys/class/tty/").append(QFileInfo(strPort).fileName()).append("/device")).canonicalFilePath();
+    QStringList slParts = strDevice.split('/');
+    QRegularExpression reInterface("^[0-9]+-[0-9.]+:[0-9]+\\.[0-9]+$");
+    int i = slParts.length()-1;
+    while (i >= 2)
+    {
+        if (reInterface.match(slParts[i]).hasMatch())
+        {
+            //Component before the interface is the device, the one before that is its hub
+            return slParts[i-2];
+        }
+        --i;
+    }
+#else
+    Q_UNUSED(strPort);
+#endif
+
+    //Topology unknown, share one set of slots between all ports
+    return HubDefaultName;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmHubScheduler::Setup(
+    QSettings *pSettings,
+    const QString &strPort
+    )
+{
+    //Selects the hub to schedule on, any slot held for a previous port is released
+    Unlock();
+    gpSettings = pSettings;
+    gstrHub = HubForPort(strPort);
+}
+
+//=============================================================================
+//=============================================================================
+QString
+DtmHubScheduler::LockName(
+    const QString &strSuffix
+    ) const
+{
+    //Lock files are shared by every instance on this machine
+    return QDir::tempPath().append("/ExitDTM-hub-").append(QString(gstrHub).replace("/", "_")).append("-").append(strSuffix).append(".lock");
+}
+
+//=============================================================================
+//=============================================================================
+quint8
+DtmHubScheduler::Limit(
+    )
+{
+    //Current number of concurrent escapes allowed on the hub
+    if (gpSettings == NULL)
+    {
+        return HubDefaultLimit;
+    }
+    gpSettings->sync();
+    return (quint8)qBound(1, gpSettings->value(QString("Hubs/").append(gstrHub).append("/Limit"), HubDefaultLimit).toInt(), (int)HubMaxLimit);
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmHubScheduler::TryAcquire(
+    )
+{
+    //Takes a free slot on the hub and then the opening lock, returns false if either is unavailable
+    if (gplfSlot == NULL)
+    {
+        quint8 intLimit = Limit();
+        quint8 i = 0;
+        while (i < intLimit && gplfSlot == NULL)
+        {
+            QLockFile *plfSlot = new QLockFile(LockName(QString("slot").append(QString::number(i))));
+            plfSlot->setStaleLockTime(HubLockStaleTime);
+            if (plfSlot->tryLock(0) == true)
+            {
+                gplfSlot = plfSlot;
+            }
+            else
+            {
+                delete plfSlot;
+            }
+            ++i;
+        }
+
+        if (gplfSlot == NULL)
+        {
+            //Hub is at its limit
+            return false;
+        }
+    }
+
+    if (gplfOpening == NULL)
+    {
+        QLockFile *plfOpening = new QLockFile(LockName("opening"));
+        plfOpening->setStaleLockTime(HubLockStaleTime);
+        if (plfOpening->tryLock(0) == false)
+        {
+            //Another instance is opening its port
+            delete plfOpening;
+            return false;
+        }
+        gplfOpening = plfOpening;
+    }
+
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmHubScheduler::OpeningFinished(
+    )
+{
+    //Lets the next instance on the hub open its port
+    if (gplfOpening != NULL)
+    {
+        gplfOpening->unlock();
+        delete gplfOpening;
+        gplfOpening = NULL;
+    }
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmHubScheduler::Release(
+    int intExitCode,
+    qint64 intEscapeTime
+    )
+{
+    //Records the result to adapt the hub limit with and frees the slot, returns false if the caller needs to retry
+    gbReleasePending = true;
+    gintReleaseCode = intExitCode;
+    gintReleaseTime = intEscapeTime;
+    gintReleaseAttempts = 0;
+    return RetryRelease();
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmHubScheduler::RetryRelease(
+    )
+{
+    //Adapts the hub limit to the result (additive increase, multiplicative decrease) and frees the slot. The state
+    //lock is never waited on here, whilst another instance holds it the caller retries from its own (DtmClock) timer
+    if (gbReleasePending == true && gplfSlot != NULL && gpSettings != NULL)
+    {
+        QLockFile lfState(LockName("state"));
+        lfState.setStaleLockTime(HubLockStaleTime);
+        if (lfState.tryLock(0) == false && ++gintReleaseAttempts < HubReleaseAttempts)
+        {
+            //Another instance is updating the hub state, keep the slot until this result is in
+            return false;
+        }
+        if (lfState.isLocked() == true)
+        {
+            int intExitCode = gintReleaseCode;
+            qint64 intEscapeTime = gintReleaseTime;
+            QString strGroup = QString("Hubs/").append(gstrHub).append("/");
+            gpSettings->sync();
+            int intLimit = qBound(1, gpSettings->value(QString(strGroup).append("Limit"), HubDefaultLimit).toInt(), (int)HubMaxLimit);
+            int intSuccesses = gpSettings->value(QString(strGroup).append("Successes"), 0).toInt();
+            qint64 intAverage = gpSettings->value(QString(strGroup).append("EscapeTime"), 0).toLongLong();
+
+            if (intExitCode == ExitCodeSerialPortError || intExitCode == ExitCodeTimeout)
+            {
+                //Device dropped off the bus or never came back, back off hard
+                intLimit = qMax(1, intLimit/2);
+                intSuccesses = 0;
+            }
+            else if (intExitCode == ExitCodeOK)
+            {
+                if (intAverage > 0 && intEscapeTime > intAverage*HubSlowFactor)
+                {
+                    //Slow escape, the hub is congested
+                    intLimit = qMax(1, intLimit-1);
+                    intSuccesses = 0;
+                }
+                else
+                {
+                    ++intSuccesses;
+                    if (intSuccesses >= intLimit)
+                    {
+                        //A full round at this limit succeeded, allow one more
+                        intLimit = qMin((int)HubMaxLimit, intLimit+1);
+                        intSuccesses = 0;
+                    }
+                }
+                intAverage = (intAverage == 0 ? intEscapeTime : (intAverage*(HubAverageWeight-1) + intEscapeTime)/HubAverageWeight);
+            }
+
+            gpSettings->setValue(QString(strGroup).append("Limit"), intLimit);
+            gpSettings->setValue(QString(strGroup).append("Successes"), intSuccesses);
+            gpSettings->setValue(QString(strGroup).append("EscapeTime"), intAverage);
+            gpSettings->sync();
+            lfState.unlock();
+        }
+    }
+
+    Unlock();
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmHubScheduler::Unlock(
+    )
+{
+    //Frees the slot and opening lock without affecting the hub limit
+    gbReleasePending = false;
+    OpeningFinished();
+    if (gplfSlot != NULL)
+    {
+        gplfSlot->unlock();
+        delete gplfSlot;
+        gplfSlot = NULL;
+    }
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmHubScheduler::IsReleasing(
+    ) const
+{
+    return gbReleasePending;
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmHubScheduler::IsHolding(
+    ) const
+{
+    return (gplfSlot != NULL);
+}
+
+//=============================================================================
+//=============================================================================
+QString
+DtmHubScheduler::Hub(
+    ) const
+{
+    return gstrHub;
+}
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
@@ -0,0 +1,118 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmHubScheduler.h
+**
+** Notes: Limits how many ExitDTM instances escape modules behind the same
+**        USB hub at once and staggers their port openings. Slots are lock
+**        files shared between processes, the limit per hub adapts to the
+**        results of previous escapes.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMHUBSCHEDULER_H
+#define DTMHUBSCHEDULER_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QLockFile>
+#include <QSettings>
+#include <QString>
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+const quint8                   HubDefaultLimit            = 4; //Concurrent escapes per hub before any results are known
+const quint8                   HubMaxLimit                = 16; //Most concurrent escapes allowed per hub
+const quint16                  HubStaggerInterval         = 150; //Time (in ms) between port openings on the same hub
+const quint16                  HubWaitInterval            = 50; //Time (in ms) between attempts to get a slot
+const quint8                   HubSlowFactor              = 2; //Escapes taking this many times the average count as congestion
+const quint8                   HubAverageWeight           = 8; //Weight of the previous average escape time (1/n of new samples)
+const quint8                   HubReleaseAttempts         = 20; //Attempts (HubWaitInterval apart) at updating the hub state before the result is dropped
+const int                      HubLockStaleTime           = 60000; //Time (in ms) after which a lock left by a hung instance is ignored
+const QString                  HubDefaultName             = "default"; //Hub used when the USB topology is unknown
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+class DtmHubScheduler
+{
+public:
+    DtmHubScheduler(
+        );
+    ~DtmHubScheduler(
+        );
+    static QString
+    HubForPort(
+        const QString &strPort
+        );
+    void
+    Setup(
+        QSettings *pSettings,
+        const QString &strPort
+        );
+    bool
+    TryAcquire(
+        );
+    void
+    OpeningFinished(
+        );
+    bool
+    Release(
+        int intExitCode,
+        qint64 intEscapeTime
+        );
+    bool
+    RetryRelease(
+        );
+    bool
+    IsReleasing(
+        ) const;
+    bool
+    IsHolding(
+        ) const;
+    QString
+    Hub(
+        ) const;
+    quint8
+    Limit(
+        );
+    void
+    Unlock(
+        );
+
+private:
+    QString
+    LockName(
+        const QString &strSuffix
+        ) const;
+
+    QSettings *gpSettings; //Settings shared between instances, holds the adaptive state of each hub
+    QString gstrHub; //Hub the port is connected to
+    QLockFile *gplfSlot; //Escape slot held on the hub (NULL if none)
+    QLockFile *gplfOpening; //Held whilst this instance opens its port, staggers openings on the hub
+    bool gbReleasePending; //True whilst a result is waiting for the hub state to be free
+    int gintReleaseCode; //Exit code of the result waiting to be applied
+    qint64 gintReleaseTime; //Escape time (in ms) of the result waiting to be applied
+    quint8 gintReleaseAttempts; //Times the hub state was busy for the waiting result
+};
+
+#endif // DTMHUBSCHEDULER_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
@@ -0,0 +1,209 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmLicenseStore.cpp
+**
+** Notes: Memory mapped key file of Bluetooth address to license pairs,
+**        indexed by address at load so a license can be installed offline
+**        in the same session as the license check
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include "DtmLicenseStore.h"
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+DtmLicenseStore::DtmLicenseStore(
+    )
+{
+    gpMapping = NULL;
+    gintMappedSize = 0;
+}
+
+//=============================================================================
+//=============================================================================
+DtmLicenseStore::~DtmLicenseStore(
+    )
+{
+    Close();
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmLicenseStore::ParseAddress(
+    const char *pAddress,
+    quint64 *pintAddress
+    )
+{
+    //Converts 12 hex digits to a 48-bit address
+    quint64 intAddress = 0;
+    quint8 i = 0;
+    while (i < LicenseAddressLength)
+    {
+        char chDigit = pAddress[i];
+        intAddress <<= 4;
+        if (chDigit >= '0' && chDigit <= '9')
+        {
+            intAddress |= (chDigit - '0');
+        }
+        else if (chDigit >= 'a' && chDigit <= 'f')
+        {
+            intAddress |= (chDigit - 'a' + 10);
+        }
+        else if (chDigit >= 'A' && chDigit <= 'F')
+        {
+            intAddress |= (chDigit - 'A' + 10);
+        }
+        else
+        {
+            return false;
+        }
+        ++i;
+    }
+    *pintAddress = intAddress;
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmLicenseStore::Open(
+    const QString &strFilename
+    )
+{
+    //Maps the key file and indexes every address, malformed lines are skipped
+    Close();
+    gfKeyFile.setFileName(strFilename);
+    if (!gfKeyFile.open(QIODevice::ReadOnly) || gfKeyFile.size() == 0)
+    {
+        //Unable to open file or file empty
+        gfKeyFile.close();
+        return false;
+    }
+
+    gintMappedSize = gfKeyFile.size();
+    gpMapping = gfKeyFile.map(0, gintMappedSize);
+    if (gpMapping == NULL)
+    {
+        //Unable to map file
+        Close();
+        return false;
+    }
+
+    ghshIndex.reserve((int)qMin(gintMappedSize/LicenseEstimatedLineLength, (qint64)0x7fffffff));
+    const char *pData = (const char *)gpMapping;
+    qint64 intPosition = 0;
+    while (intPosition < gintMappedSize)
+    {
+        //Find the end of this line
+        qint64 intLineEnd = intPosition;
+        while (intLineEnd < gintMappedSize && pData[intLineEnd] != '\n')
+        {
+            ++intLineEnd;
+        }
+
+        quint64 intAddress;
+        if (intLineEnd - intPosition > LicenseAddressLength && pData[intPosition] != '#' && ParseAddress(&pData[intPosition], &intAddress) == true)
+        {
+            //Skip separators then take the license up to the next whitespace
+            qint64 intKeyStart = intPosition + LicenseAddressLength;
+            while (intKeyStart < intLineEnd && (pData[intKeyStart] == ' ' || pData[intKeyStart] == '\t' || pData[intKeyStart] == ',' || pData[intKeyStart] == '='))
+            {
+                ++intKeyStart;
+            }
+            qint64 intKeyEnd = intKeyStart;
+            while (intKeyEnd < intLineEnd && pData[intKeyEnd] != ' ' && pData[intKeyEnd] != '\t' && pData[intKeyEnd] != '\r' && pData[intKeyEnd] != ',')
+            {
+                ++intKeyEnd;
+            }
+
+            if (intKeyEnd > intKeyStart && intKeyEnd - intKeyStart <= LicenseMaxKeyLength && intKeyStart != intPosition + LicenseAddressLength)
+            {
+                DtmLicenseEntry dleEntry;
+                dleEntry.intOffset = intKeyStart;
+                dleEntry.intLength = (quint16)(intKeyEnd - intKeyStart);
+                ghshIndex.insert(intAddress, dleEntry);
+            }
+        }
+
+        intPosition = intLineEnd + 1;
+    }
+
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmLicenseStore::Close(
+    )
+{
+    if (gpMapping != NULL)
+    {
+        gfKeyFile.unmap(gpMapping);
+        gpMapping = NULL;
+    }
+    gintMappedSize = 0;
+    ghshIndex.clear();
+    gfKeyFile.close();
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmLicenseStore::IsOpen(
+    ) const
+{
+    return (gpMapping != NULL);
+}
+
+//=============================================================================
+//=============================================================================
+qint32
+DtmLicenseStore::Count(
+    ) const
+{
+    return ghshIndex.count();
+}
+
+//=============================================================================
+//=============================================================================
+QByteArray
+DtmLicenseStore::Lookup(
+    const QString &strAddress
+    ) const
+{
+    //Returns the license for an address, or an empty array if there is none
+    QByteArray baAddress = strAddress.toLatin1();
+    quint64 intAddress;
+    if (gpMapping == NULL || baAddress.length() != LicenseAddressLength || ParseAddress(baAddress.constData(), &intAddress) == false || ghshIndex.contains(intAddress) == false)
+    {
+        return QByteArray();
+    }
+
+    DtmLicenseEntry dleEntry = ghshIndex.value(intAddress);
+    return QByteArray((const char *)gpMapping + dleEntry.intOffset, dleEntry.intLength);
+}
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
@@ -0,0 +1,101 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmLicenseStore.h
+**
+** Notes: Memory mapped key file of Bluetooth address to license pairs,
+**        indexed by address at load so a license can be installed offline
+**        in the same session as the license check
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMLICENSESTORE_H
+#define DTMLICENSESTORE_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QFile>
+#include <QByteArray>
+#include <QHash>
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+//File layout: one pair per line, 12 hex digit address then the license,
+//separated by spaces, tabs, a comma or '='. Lines starting with # are
+//ignored.
+const quint8                   LicenseAddressLength       = 12; //Hex digits in a Bluetooth address
+const quint16                  LicenseMaxKeyLength        = 256; //Longest license accepted from the key file
+const quint8                   LicenseEstimatedLineLength = 48; //Used to size the index before parsing
+const QString                  LicensePlaceholder         = "0016A4C0FFEE"; //Address reported by at i 4 when no license is present
+const char                     LicenseInstallCommand[]    = "at+lic "; //Command (followed by the license) used to write a license to the module
+
+/******************************************************************************/
+// Structures
+/******************************************************************************/
+struct DtmLicenseEntry
+{
+    qint64 intOffset; //Position of the license in the key file
+    quint16 intLength; //Length of the license
+};
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+class DtmLicenseStore
+{
+public:
+    DtmLicenseStore(
+        );
+    ~DtmLicenseStore(
+        );
+    bool
+    Open(
+        const QString &strFilename
+        );
+    void
+    Close(
+        );
+    bool
+    IsOpen(
+        ) const;
+    qint32
+    Count(
+        ) const;
+    QByteArray
+    Lookup(
+        const QString &strAddress
+        ) const;
+
+private:
+    static bool
+    ParseAddress(
+        const char *pAddress,
+        quint64 *pintAddress
+        );
+
+    QFile gfKeyFile; //Key file
+    uchar *gpMapping; //Key file mapped into memory (NULL if not open)
+    qint64 gintMappedSize; //Size of the mapped region
+    QHash<quint64, DtmLicenseEntry> ghshIndex; //Location of the license for each address
+};
+
+#endif // DTMLICENSESTORE_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
@@ -0,0 +1,130 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmLoopMonitor.cpp
+**
+** Notes: Event loop lag monitor. A heartbeat timer measures how late the
+**        loop dispatches it and handlers report how long they ran for, so
+**        a slow escape can be traced to work which delayed serial handling.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include "DtmLoopMonitor.h"
+#include "DtmTimeline.h"
+
+/******************************************************************************/
+// Static Members
+/******************************************************************************/
+DtmLoopMonitor *DtmLoopMonitor::gpActive = NULL;
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+DtmLoopMonitor::DtmLoopMonitor(
+    DtmMetrics *pMetrics,
+    QObject *parent
+    ) : QObject(parent)
+{
+    gpMetrics = pMetrics;
+    gintLastBeat = 0;
+    gintThreshold = 0;
+    gintSlowestHandler = LoopMonitorNoHandler;
+    gintSlowestTime = 0;
+    gtmrHeartbeat.setTimerType(Qt::PreciseTimer);
+    gtmrHeartbeat.setInterval(LoopMonitorInterval);
+    connect(&gtmrHeartbeat, SIGNAL(timeout()), this, SLOT(Heartbeat()));
+}
+
+//=============================================================================
+//=============================================================================
+DtmLoopMonitor::~DtmLoopMonitor(
+    )
+{
+    if (gpActive == this)
+    {
+        gpActive = NULL;
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmLoopMonitor::Start(
+    qint32 intThreshold
+    )
+{
+    //Starts the heartbeat, lag over the threshold (in ms) is reported as a stall
+    gintThreshold = (qint64)intThreshold*1000000;
+    gtmrRunning.start();
+    gintLastBeat = 0;
+    gpActive = this;
+    gtmrHeartbeat.start();
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmLoopMonitor::HandlerFinished(
+    quint8 intHandler,
+    qint64 intNanoseconds
+    )
+{
+    //Records the handler and remembers it if it is the slowest since the last heartbeat
+    gpActive->gpMetrics->HandlerCompleted(intHandler, intNanoseconds);
+    if (intNanoseconds > gpActive->gintSlowestTime)
+    {
+        gpActive->gintSlowestHandler = intHandler;
+        gpActive->gintSlowestTime = intNanoseconds;
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmLoopMonitor::Heartbeat(
+    )
+{
+    //Lag is how much later than the interval the heartbeat was dispatched
+    qint64 intNow = gtmrRunning.nsecsElapsed();
+    qint64 intLag = intNow - gintLastBeat - (qint64)LoopMonitorInterval*1000000;
+    gintLastBeat = intNow;
+    if (intLag < 0)
+    {
+        intLag = 0;
+    }
+    gpMetrics->LoopLag(intLag);
+
+    if (gintThreshold > 0 && intLag > gintThreshold)
+    {
+        //Blame the slowest handler which ran in the gap, if any did
+        gpMetrics->LoopStall();
+        if (DtmTimeline::IsEnabled() == true)
+        {
+            DtmTimeline::Record("LoopStall", "loop", TimelinePhaseInstant, intLag/1000000);
+        }
+        emit Stalled(intLag/1000000, (gintSlowestHandler == LoopMonitorNoHandler ? QString("unknown") : QString(DtmMetrics::HandlerName(gintSlowestHandler))));
+    }
+    gintSlowestHandler = LoopMonitorNoHandler;
+    gintSlowestTime = 0;
+}
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
@@ -0,0 +1,129 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmLoopMonitor.h
+**
+** Notes: Event loop lag monitor. A heartbeat timer measures how late the
+**        loop dispatches it and handlers report how long they ran for, so
+**        a slow escape can be traced to work which delayed serial handling.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMLOOPMONITOR_H
+#define DTMLOOPMONITOR_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "DtmMetrics.h"
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+const quint16                  LoopMonitorInterval        = 10; //Time (in ms) between heartbeats
+const quint8                   LoopMonitorNoHandler       = 0xff; //No handler has run since the last heartbeat
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+class DtmLoopMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DtmLoopMonitor(
+        DtmMetrics *pMetrics,
+        QObject *parent = 0
+        );
+    ~DtmLoopMonitor(
+        );
+    void
+    Start(
+        qint32 intThreshold
+        );
+    static inline bool
+    IsEnabled(
+        )
+    {
+        return (gpActive != NULL);
+    }
+    static inline qint64
+    Now(
+        )
+    {
+        return gpActive->gtmrRunning.nsecsElapsed();
+    }
+    static void
+    HandlerFinished(
+        quint8 intHandler,
+        qint64 intNanoseconds
+        );
+
+signals:
+    void
+    Stalled(
+        qint64 intLag,
+        const QString &strHandler
+        );
+
+private slots:
+    void
+    Heartbeat(
+        );
+
+private:
+    static DtmLoopMonitor *gpActive; //Running monitor handlers report to (NULL if disabled)
+    DtmMetrics *gpMetrics; //Metrics the lag and handler durations are added to
+    QTimer gtmrHeartbeat; //Heartbeat timer, always on the wall clock
+    QElapsedTimer gtmrRunning; //Time since the monitor was started
+    qint64 gintLastBeat; //Time (in ns) of the previous heartbeat
+    qint64 gintThreshold; //Lag (in ns) reported as a stall
+    quint8 gintSlowestHandler; //Longest running handler since the previous heartbeat
+    qint64 gintSlowestTime; //Time (in ns) the above handler ran for
+};
+
+class DtmLoopScope
+{
+public:
+    inline DtmLoopScope(
+        quint8 intHandler
+        )
+    {
+        gintHandler = intHandler;
+        gintStart = (DtmLoopMonitor::IsEnabled() == true ? DtmLoopMonitor::Now() : -1);
+    }
+    inline ~DtmLoopScope(
+        )
+    {
+        if (gintStart >= 0 && DtmLoopMonitor::IsEnabled() == true)
+        {
+            DtmLoopMonitor::HandlerFinished(gintHandler, DtmLoopMonitor::Now() - gintStart);
+        }
+    }
+
+private:
+    quint8 gintHandler; //Handler being timed
+    qint64 gintStart; //Time (in ns) the handler started, negative if not monitoring
+};
+
+#endif // DTMLOOPMONITOR_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
@@ -26,6 +26,15 @@
 /******************************************************************************/
 #include "DtmMainWindow.h"
 #include "ui_DtmMainWindow.h"
+#include "DtmSupervisor.h"
+#include <QFile>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
 
 /******************************************************************************/
 // Local Functions or Private Members
@@ -38,12 +47,54 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
     //Define default variable values
     gintRXBytes = 0;
     gintTXBytes = 0;
+    gintTXPending = 0;
     gchTermBusyLines = 0;
     gbCTSStatus = 0;
     gintProgramState = ProgramStatusIdle;
-
-    //Clear display buffer
+    gintRetryMaxAttempts = DTMRetryDefaultAttempts;
+    gintRetryInitialInterval = DTMRetryInitialInterval;
+    gintRetryInterval = DTMRetryInitialInterval;
+    gintResetLine = ResetLineNone;
+    gintExitAttempts = 0;
+    gbReplayActive = false;
+    gbReplayPortOpen = false;
+    gbReplayRealTime = false;
+    gintReplaySignals = 0;
+    gintTraceSignals = 0;
+    gbAutoBaud = false;
+    gintProbeIndex = 0;
+    gbVerifyFirst = false;
+    gbEscapeSkipped = false;
+    gintSignalPollInterval = ProfileMaxPollInterval;
+    gbHubSchedule = false;
+    gbHealth = false;
+    gbQuarantine = false;
+    gdblHealthDrift = HealthDefaultDrift;
+    gintStartupConstructed = -1;
+    gintStartupFirstTX = -1;
+    gpSession = NULL;
+    gbLicenseInstalled = false;
+    gintPoolTrigger = PoolTriggerNone;
+    gbPoolArmed = false;
+    gintHighSpeedBaud = 0;
+    gbHighSpeedDone = false;
+    gintHighSpeedStep = HighSpeedStepMeasure;
+    gintHighSpeedExpected = 0;
+    gintHighSpeedOrigBaud = 0;
+    gintHighSpeedOrigFlow = QSerialPort::NoFlowControl;
+    gintIdentifyBaud = DTMBaudRate;
+    gintIdentifyFlow = DTMFlowControl;
+    gintHighSpeedBefore = 0;
+    gintResultSlot = -1;
+
+    //Open persistent settings
+    gpPersistentSettings = new QSettings(QSettings::IniFormat, QSettings::UserScope, "Laird", "ExitDTM");
+
+    //Clear display buffer and reserve the receive buffers up front so the RX path does not allocate
     gbaDisplayBuffer.clear();
+    gbaDisplayBuffer.reserve(DisplayBufferReserve);
+    gbaTermBusyData.reserve(TermBusyDataLimit);
+    gbaTXQueue.reserve(TXQueueReserve);
 
     //Move to 'About' tab
     ui->selector_Tab->setCurrentIndex(ui->selector_Tab->indexOf(ui->tab_Config));
@@ -51,29 +102,92 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
     //Connect quit signals
     connect(ui->btn_Quit, SIGNAL(clicked()), this, SLOT(close()));
 
-    //Populate the list of devices
-    RefreshSerialDevices();
-
     //Set title
     setWindowTitle(QString("ExitDTM (v").append(AppVersion).append(")"));
 
     //Configure the signal and program advancement timer
-    gpSignalTimer = new QTimer(this);
+    gpSignalTimer = new DtmTimer(this);
     connect(gpSignalTimer, SIGNAL(timeout()), this, SLOT(SerialStatusSlot()));
 
     //Configure the program timeout timer
-    gpSystemTimeout = new QTimer(this);
+    gpSystemTimeout = new DtmTimer(this);
     connect(gpSystemTimeout, SIGNAL(timeout()), this, SLOT(SystemTimeout()));
 
     //Configure the exit timer
-    gpExitTimer = new QTimer(this);
+    gpExitTimer = new DtmTimer(this);
     gpExitTimer->setSingleShot(true);
     gpExitTimer->setInterval(10);
     connect(gpExitTimer, SIGNAL(timeout()), this, SLOT(ForceClose()));
 
+    //Configure the exit DTM command resend timer
+    gpRetryTimer = new DtmTimer(this);
+    gpRetryTimer->setSingleShot(true);
+    connect(gpRetryTimer, SIGNAL(timeout()), this, SLOT(RetryExitDTM()));
+
+    //Configure the reset line pulse timer
+    gpResetPulseTimer = new DtmTimer(this);
+    gpResetPulseTimer->setSingleShot(true);
+    gpResetPulseTimer->setInterval(DTMResetPulseTime);
+    connect(gpResetPulseTimer, SIGNAL(timeout()), this, SLOT(ResetPulseFinished()));
+
+    //Configure the trace replay timer
+    gpReplayTimer = new DtmTimer(this);
+    gpReplayTimer->setSingleShot(true);
+    connect(gpReplayTimer, SIGNAL(timeout()), this, SLOT(ReplayStep()));
+
+    //Configure the metrics file timer
+    gpMetricsTimer = new DtmTimer(this);
+    gpMetricsTimer->setInterval(MetricsWriteInterval);
+    connect(gpMetricsTimer, SIGNAL(timeout()), this, SLOT(WriteMetrics()));
+
+    //Configure the baud rate detection timer
+    gpBaudProbeTimer = new DtmTimer(this);
+    gpBaudProbeTimer->setSingleShot(true);
+    gpBaudProbeTimer->setInterval(BaudProbeTimeout);
+    connect(gpBaudProbeTimer, SIGNAL(timeout()), this, SLOT(ProbeNextBaud()));
+
+    //Configure the verify mode probe timer
+    gpVerifyTimer = new DtmTimer(this);
+    gpVerifyTimer->setSingleShot(true);
+    gpVerifyTimer->setInterval(VerifyProbeTimeout);
+    connect(gpVerifyTimer, SIGNAL(timeout()), this, SLOT(VerifyTimeout()));
+
+    //Configure the high speed switch-over response timer
+    gpHighSpeedTimer = new DtmTimer(this);
+    gpHighSpeedTimer->setSingleShot(true);
+    gpHighSpeedTimer->setInterval(HighSpeedProbeTimeout);
+    connect(gpHighSpeedTimer, SIGNAL(timeout()), this, SLOT(HighSpeedTimeout()));
+
+    //Configure the identity response timer
+    gpIdentifyTimer = new DtmTimer(this);
+    gpIdentifyTimer->setSingleShot(true);
+    gpIdentifyTimer->setInterval(IdentifyProbeTimeout);
+    connect(gpIdentifyTimer, SIGNAL(timeout()), this, SLOT(IdentifyTimeout()));
+
+    //Configure the terminal redraw timer (display only, so it always runs on the wall clock)
+    gpDisplayTimer = new QTimer(this);
+    gpDisplayTimer->setSingleShot(true);
+    gpDisplayTimer->setInterval(DisplayRefreshInterval);
+    connect(gpDisplayTimer, SIGNAL(timeout()), this, SLOT(RefreshDisplay()));
+
+    //Configure the event loop lag monitor (only started if requested)
+    gpLoopMonitor = new DtmLoopMonitor(&gdmMetrics, this);
+    connect(gpLoopMonitor, SIGNAL(Stalled(qint64,QString)), this, SLOT(LoopStalled(qint64,QString)));
+
+    //Configure the hub slot wait timer
+    gpHubWaitTimer = new DtmTimer(this);
+    gpHubWaitTimer->setInterval(HubWaitInterval);
+    connect(gpHubWaitTimer, SIGNAL(timeout()), this, SLOT(HubWaitFinished()));
+
+    //Configure the hub opening stagger timer
+    gpHubStaggerTimer = new DtmTimer(this);
+    gpHubStaggerTimer->setSingleShot(true);
+    gpHubStaggerTimer->setInterval(HubStaggerInterval);
+    connect(gpHubStaggerTimer, SIGNAL(timeout()), this, SLOT(HubStaggerFinished()));
+
 #ifdef TARGET_OS_MAC
     //Because mac just shows CTS as always being asserted which is clearly wrong
-    gpMacDoesntSupportCTSWorkaroundTimer = new QTimer(this);
+    gpMacDoesntSupportCTSWorkaroundTimer = new DtmTimer(this);
     gpMacDoesntSupportCTSWorkaroundTimer->setSingleShot(true);
     gpMacDoesntSupportCTSWorkaroundTimer->setInterval(350);
     connect(gpMacDoesntSupportCTSWorkaroundTimer, SIGNAL(timeout()), this, SLOT(ContinueOperationMacDoesntSupportCTSWorkaroundFunction()));
@@ -84,20 +198,6 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
     connect(&gspSerialPort, SIGNAL(error(QSerialPort::SerialPortError)), this, SLOT(SerialError(QSerialPort::SerialPortError)));
     connect(&gspSerialPort, SIGNAL(bytesWritten(qint64)), this, SLOT(SerialBytesWritten(qint64)));
 
-    //Change terminal font to a monospaced font
-#pragma warning("TODO: Revert manual font selection when QTBUG-54623 is fixed")
-#ifdef _WIN32
-    QFont fntTmpFnt2 = QFontDatabase::systemFont(QFontDatabase::FixedFont);
-#elif __APPLE__
-    QFont fntTmpFnt2 = QFontDatabase::systemFont(QFontDatabase::FixedFont);
-#else
-    //Fix for qt bug
-    QFont fntTmpFnt2 = QFont("monospace");
-#endif
-    QFontMetrics tmTmpFM(fntTmpFnt2);
-    ui->text_TermEditData->setFont(fntTmpFnt2);
-    ui->text_TermEditData->setTabStopWidth(tmTmpFM.width(" ")*6);
-
     //Currently not in a state
     gintProgramState = ProgramStatusIdle;
 
@@ -107,6 +207,15 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
     bool bArgCom = false;
     bool bArgNoRecovery = false;
     bool bArgShowWindow = true;
+    bool bArgCharacterise = false;
+    bool bArgCoroutine = false;
+    bool bArgVirtualTime = false;
+    bool bArgEmptyAllowList = false;
+    QString strArgTimeline;
+    QString strArgStatus;
+    bool bArgHealthReset = false;
+    bool bArgEvents = false;
+    QString strArgReplay;
     gbExitOnFinish = false;
     while (chi < slArgs.length())
     {
@@ -121,11 +230,13 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
                 strPort.prepend("COM");
             }
 #endif
-            ui->combo_COM->setCurrentText(strPort);
+            //Use the port directly, the list of devices is only enumerated if the window is shown
+            ui->combo_COM->blockSignals(true);
+            ui->combo_COM->clear();
+            ui->combo_COM->addItem(strPort);
+            ui->combo_COM->setCurrentIndex(0);
+            ui->combo_COM->blockSignals(false);
             bArgCom = true;
-
-            //Update serial port info
-            on_combo_COM_currentIndexChanged(0);
         }
 /*        else if (slArgs[chi].left(5).toUpper() == "BAUD=")
         {
@@ -156,10 +267,202 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
             //Automatically close application once complete
             gbExitOnFinish = true;
         }
+        else if (slArgs[chi].left(6).toUpper() == "RETRY=")
+        {
+            //Number of times to resend the exit DTM command if the module does not respond
+            gintRetryMaxAttempts = qMin(slArgs[chi].right(slArgs[chi].length()-6).toUInt(), (uint)DTMRetryMaxAttempts);
+        }
+        else if (slArgs[chi].left(14).toUpper() == "RETRYINTERVAL=")
+        {
+            //Time until the first resend, doubled after every resend
+            gintRetryInitialInterval = qBound((uint)DTMRetryMinInterval, slArgs[chi].right(slArgs[chi].length()-14).toUInt(), (uint)DTMRetryMaxInterval);
+        }
+        else if (slArgs[chi].left(6).toUpper() == "RESET=")
+        {
+            //Modem line to pulse to reset the module before each resend
+            QString strLine = slArgs[chi].right(slArgs[chi].length()-6).toUpper();
+            if (strLine == "DTR")
+            {
+                gintResetLine = ResetLineDTR;
+            }
+            else if (strLine == "RTS")
+            {
+                gintResetLine = ResetLineRTS;
+            }
+        }
+        else if (slArgs[chi].left(6).toUpper() == "TRACE=")
+        {
+            //Record all serial traffic to a binary trace file
+            if (gtwTraceWriter.Open(slArgs[chi].right(slArgs[chi].length()-6)) == false)
+            {
+                ui->statusBar->showMessage("Error: Unable to create trace file");
+            }
+        }
+        else if (slArgs[chi].left(7).toUpper() == "REPLAY=")
+        {
+            //Replay a trace file instead of using a serial port
+            strArgReplay = slArgs[chi].right(slArgs[chi].length()-7);
+        }
+        else if (slArgs[chi].left(8).toUpper() == "METRICS=")
+        {
+            //Export metrics in Prometheus text format, continuing from any previous run
+            gstrMetricsFile = slArgs[chi].right(slArgs[chi].length()-8);
+            gdmMetrics.Load(gstrMetricsFile);
+            gpMetricsTimer->start();
+        }
+        else if (slArgs[chi].left(9).toUpper() == "FIRMWARE=")
+        {
+            //Only erase modules running one of these firmware versions (comma separated, a trailing * matches any suffix)
+            gslAllowedFirmware = slArgs[chi].right(slArgs[chi].length()-9).split(',', QString::SkipEmptyParts);
+            if (gslAllowedFirmware.count() == 0)
+            {
+                bArgEmptyAllowList = true;
+            }
+        }
+        else if (slArgs[chi].left(11).toUpper() == "DEVICETYPE=")
+        {
+            //Only erase modules of these device types (comma separated, a trailing * matches any suffix)
+            gslAllowedTypes = slArgs[chi].right(slArgs[chi].length()-11).split(',', QString::SkipEmptyParts);
+            if (gslAllowedTypes.count() == 0)
+            {
+                bArgEmptyAllowList = true;
+            }
+        }
+        else if (slArgs[chi].toUpper() == "EVENTS")
+        {
+            //Write progress events to stdout as they happen, one JSON object per line
+            bArgEvents = true;
+        }
+        else if (slArgs[chi].toUpper() == "HEALTH")
+        {
+            //Keep the stage time history of the port and flag it if it drifts slower
+            gbHealth = true;
+        }
+        else if (slArgs[chi].left(12).toUpper() == "HEALTHDRIFT=")
+        {
+            //Flag the port when a stage averages more than this multiple of its median time
+            gbHealth = true;
+            gdblHealthDrift = slArgs[chi].right(slArgs[chi].length()-12).toDouble();
+            if (gdblHealthDrift <= 1.0)
+            {
+                gdblHealthDrift = HealthDefaultDrift;
+            }
+        }
+        else if (slArgs[chi].toUpper() == "QUARANTINE")
+        {
+            //Refuse to use the port once it has been flagged, until its history is reset
+            gbHealth = true;
+            gbQuarantine = true;
+        }
+        else if (slArgs[chi].toUpper() == "HEALTHRESET")
+        {
+            //Forget the history of the port (after repairing the fixture)
+            gbHealth = true;
+            bArgHealthReset = true;
+        }
+        else if (slArgs[chi].left(7).toUpper() == "STATUS=")
+        {
+            //Publish the live status of the port in shared memory under this name
+            strArgStatus = slArgs[chi].right(slArgs[chi].length()-7);
+        }
+        else if (slArgs[chi].left(9).toUpper() == "LOOPWARN=")
+        {
+            //Monitor event loop lag and handler durations, warning when the loop is held up for longer than this (in ms)
+            qint32 intThreshold = slArgs[chi].right(slArgs[chi].length()-9).toInt();
+            if (intThreshold > 0)
+            {
+                gpLoopMonitor->Start(intThreshold);
+            }
+        }
+        else if (slArgs[chi].toUpper() == "VERIFY")
+        {
+            //Check if the module is already out of DTM before escaping (and erasing) it
+            gbVerifyFirst = true;
+        }
+        else if (slArgs[chi].toUpper() == "AUTOBAUD")
+        {
+            //Detect the baud rate and flow control of the module once out of DTM
+            gbAutoBaud = true;
+        }
+        else if (slArgs[chi].left(13).toUpper() == "STARTUPBENCH=")
+        {
+            //Append the startup timings and peak memory usage to a benchmark file on exit
+            gstrStartupBenchFile = slArgs[chi].right(slArgs[chi].length()-13);
+        }
+        else if (slArgs[chi].toUpper() == "HUBSCHEDULE")
+        {
+            //Share the USB hub with other instances, limiting concurrent escapes and staggering openings
+            gbHubSchedule = true;
+        }
+        else if (slArgs[chi].left(12).toUpper() == "LICENSEFILE=")
+        {
+            //Install licenses from a key file on modules which do not have one
+            if (glsLicenseStore.Open(slArgs[chi].right(slArgs[chi].length()-12)) == false)
+            {
+                ui->statusBar->showMessage("Error: Unable to open license key file");
+            }
+        }
+        else if (slArgs[chi].left(9).toUpper() == "TIMELINE=")
+        {
+            //Record a timeline of stages, serial activity and timers, written as trace-event JSON on exit
+            strArgTimeline = slArgs[chi].right(slArgs[chi].length()-9);
+        }
+        else if (slArgs[chi].left(10).toUpper() == "HIGHSPEED=")
+        {
+            //Move the module and host to this baud rate after the escape
+            gintHighSpeedBaud = slArgs[chi].right(slArgs[chi].length()-10).toInt();
+        }
+        else if (slArgs[chi].left(13).toUpper() == "HIGHSPEEDCMD=")
+        {
+            //Command used to change the UART rate of the module, %1 is replaced with the rate
+            gstrHighSpeedCommand = slArgs[chi].right(slArgs[chi].length()-13);
+        }
+        else if (slArgs[chi].left(11).toUpper() == "RESULTSLOT=")
+        {
+            //Started by a supervisor, publish the state and result in its shared table (key,slot)
+            QStringList slSlot = slArgs[chi].right(slArgs[chi].length()-11).split(',');
+            if (slSlot.length() == 2 && grtResultTable.Attach(slSlot[0]) == true)
+            {
+                gintResultSlot = slSlot[1].toInt();
+            }
+        }
+        else if (slArgs[chi].left(4).toUpper() == "CPU=")
+        {
+            //Run on a single core
+            DtmSupervisor::PinToCore(slArgs[chi].right(slArgs[chi].length()-4).toInt());
+        }
+        else if (slArgs[chi].left(5).toUpper() == "POOL=")
+        {
+            //Keep the port open between modules and start on the next module when DSR is asserted
+            if (slArgs[chi].right(slArgs[chi].length()-5).toUpper() == "DSR")
+            {
+                gintPoolTrigger = PoolTriggerDSR;
+            }
+        }
+        else if (slArgs[chi].toUpper() == "COROUTINE")
+        {
+            //Escape using the coroutine session instead of the state machine
+            bArgCoroutine = true;
+        }
+        else if (slArgs[chi].toUpper() == "CHARACTERISE")
+        {
+            //Measure the latency of the adapter through a loopback plug instead of escaping a module
+            bArgCharacterise = true;
+        }
+        else if (slArgs[chi].toUpper() == "VIRTUALTIME")
+        {
+            //Replay with the captured timing on a virtual clock, timers fire without waiting
+            bArgVirtualTime = true;
+        }
+        else if (slArgs[chi].toUpper() == "REPLAYREALTIME")
+        {
+            //Replay with the captured timing
+            gbReplayRealTime = true;
+        }
         else if (slArgs[chi].toUpper() == "NOWINDOW")
         {
             //Hide window
-            if (gbExitOnFinish == true && bArgCom == true && bArgNoRecovery == false)
+            if (gbExitOnFinish == true && (bArgCom == true || strArgReplay.length() > 0) && bArgNoRecovery == false)
             {
                 //Hide the window
                 bArgShowWindow = false;
@@ -168,17 +471,109 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
         ++chi;
     }
 
+    if (gintPoolTrigger != PoolTriggerNone)
+    {
+        //Pooled ports run until closed, one module after another
+        gbExitOnFinish = false;
+    }
+
+    if (bArgVirtualTime == true && strArgReplay.length() > 0)
+    {
+        //A real port runs in real time, only a replayed trace (or the scripted port of the tests) can follow a virtual clock
+        DtmClock::SetVirtual(true);
+    }
+
+    if (bArgEmptyAllowList == true)
+    {
+        //An empty list would otherwise allow every module to be erased, which is not what was asked for
+        bArgNoRecovery = true;
+        bArgShowWindow = true;
+        ui->statusBar->showMessage("Error: FIRMWARE= and DEVICETYPE= need at least one value, no escape has been started");
+        if (gbExitOnFinish == true)
+        {
+            //Exit with error code
+            gintExitCode = ExitCodeIdentityMismatch;
+            gpExitTimer->start();
+        }
+    }
+
+    if (gintHighSpeedBaud > 0 && gstrHighSpeedCommand.indexOf("%1") == -1)
+    {
+        //The switch-over needs to know how to change the rate of the module
+        gintHighSpeedBaud = 0;
+        ui->statusBar->showMessage("Error: HIGHSPEEDCMD must be given (with %1 for the rate) to use HIGHSPEED");
+    }
+
+    if (gbHealth == true && strArgReplay.length() == 0 && ui->combo_COM->currentText().length() > 0)
+    {
+        //Load the history of the port, a replayed trace says nothing about its health
+        gphPortHealth.Setup(gpPersistentSettings, ui->combo_COM->currentText(), gdblHealthDrift, gbQuarantine);
+        if (bArgHealthReset == true)
+        {
+            gphPortHealth.Reset();
+        }
+    }
+
+    if (bArgEvents == true)
+    {
+        DtmEvent::Enable(ui->combo_COM->currentText());
+    }
+
+    if (strArgStatus.length() > 0 && gsbStatusBlock.Create(strArgStatus, ui->combo_COM->currentText()) == false)
+    {
+        ui->statusBar->showMessage(QString("Error: Unable to create the shared memory status block: ").append(gsbStatusBlock.ErrorString()));
+    }
+
+    if (strArgTimeline.length() > 0 && DtmTimeline::Enable(strArgTimeline, ui->combo_COM->currentText()) == true && bArgShowWindow == true)
+    {
+        //Include repaints of the terminal on the timeline
+        ui->text_TermEditData->viewport()->installEventFilter(this);
+    }
+
     if (bArgShowWindow == true)
     {
+        //Populate the list of devices (keeping any port given on the command line selected)
+        RefreshSerialDevices();
+
+        //Change terminal font to a monospaced font
+#pragma warning("TODO: Revert manual font selection when QTBUG-54623 is fixed")
+#ifdef _WIN32
+        QFont fntTmpFnt2 = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+#elif __APPLE__
+        QFont fntTmpFnt2 = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+#else
+        //Fix for qt bug
+        QFont fntTmpFnt2 = QFont("monospace");
+#endif
+        QFontMetrics tmTmpFM(fntTmpFnt2);
+        ui->text_TermEditData->setFont(fntTmpFnt2);
+        ui->text_TermEditData->setTabStopWidth(tmTmpFM.width(" ")*6);
+
         //Show the window
         this->show();
     }
 
-    if (bArgCom == true && bArgNoRecovery == false)
+    if (bArgCharacterise == true && bArgCom == true)
+    {
+        //Profile the adapter, no module is attached
+        CharacteriseAdapter();
+    }
+    else if (strArgReplay.length() > 0 && bArgEmptyAllowList == false)
+    {
+        //Feed a captured trace through the state machine
+        StartReplay(strArgReplay);
+    }
+    else if (bArgCoroutine == true && bArgCom == true && bArgNoRecovery == false)
+    {
+        //Escape as a coroutine session
+        StartCoroutineSession();
+    }
+    else if (bArgCom == true && bArgNoRecovery == false)
     {
         //Enough information to connect!
-        OpenDevice(DTMBaudRate, DTMFlowControl);
+        StartSession();
     }
+    gintStartupConstructed = gtmrProcessStart.nsecsElapsed();
 }
 
 //=============================================================================
@@ -192,6 +587,18 @@ MainWindow::~MainWindow(){
     disconnect(this, SLOT(SerialBytesWritten(qint64)));
     disconnect(this, SLOT(SystemTimeout()));
     disconnect(this, SLOT(ForceClose()));
+    disconnect(this, SLOT(RetryExitDTM()));
+    disconnect(this, SLOT(ResetPulseFinished()));
+    disconnect(this, SLOT(ReplayStep()));
+    disconnect(this, SLOT(WriteMetrics()));
+    disconnect(this, SLOT(ProbeNextBaud()));
+    disconnect(this, SLOT(VerifyTimeout()));
+    disconnect(this, SLOT(HubWaitFinished()));
+    disconnect(this, SLOT(HubStaggerFinished()));
+    disconnect(this, SLOT(HighSpeedTimeout()));
+    disconnect(this, SLOT(IdentifyTimeout()));
+    disconnect(this, SLOT(RefreshDisplay()));
+    disconnect(this, SLOT(LoopStalled(qint64,QString)));
 #ifdef TARGET_OS_MAC
     disconnect(this, SLOT(ContinueOperationMacDoesntSupportCTSWorkaroundFunction()));
 #endif
@@ -209,10 +616,28 @@ MainWindow::~MainWindow(){
         gpSystemTimeout->stop();
     }
 
+    //Write final metrics
+    WriteMetrics();
+    WriteStartupBench();
+    DtmTimeline::Flush();
+
     //Delete variables
     delete gpSignalTimer;
     delete gpSystemTimeout;
     delete gpExitTimer;
+    delete gpRetryTimer;
+    delete gpResetPulseTimer;
+    delete gpReplayTimer;
+    delete gpMetricsTimer;
+    delete gpBaudProbeTimer;
+    delete gpVerifyTimer;
+    delete gpHubWaitTimer;
+    delete gpHubStaggerTimer;
+    delete gpHighSpeedTimer;
+    delete gpIdentifyTimer;
+    delete gpDisplayTimer;
+    delete gpLoopMonitor;
+    delete gpPersistentSettings;
 #ifdef TARGET_OS_MAC
     delete gpMacDoesntSupportCTSWorkaroundTimer;
 #endif
@@ -229,7 +654,7 @@ MainWindow::on_btn_Connect_clicked(
     if (gintProgramState == ProgramStatusIdle)
     {
         //Not currently busy
-        OpenDevice(DTMBaudRate, DTMFlowControl);
+        StartSession();
     }
 }
 
@@ -240,20 +665,43 @@ MainWindow::TermClose(
     )
 {
     //Close, but first clear up from download/streaming
-    gintProgramState = ProgramStatusIdle;
-    gpSystemTimeout->stop();
+    SetProgramState(ProgramStatusIdle);
 
-    //Close the serial port
-    while (gspSerialPort.isOpen() == true)
+    //Discard anything still queued for the module
+    gbaTXQueue.resize(0);
+    gintTXPending = 0;
+    gdmMetrics.TXPending(0);
+    gpSystemTimeout->stop();
+    gpRetryTimer->stop();
+    gpResetPulseTimer->stop();
+    gpBaudProbeTimer->stop();
+    gpVerifyTimer->stop();
+    gpHighSpeedTimer->stop();
+    gpIdentifyTimer->stop();
+
+    if (gintPoolTrigger != PoolTriggerNone && gspSerialPort.isOpen() == true)
     {
+        //Pooled port: keep it open (and the modem lines polled) for the next module, only dropping stale data
         gspSerialPort.clear();
-        gspSerialPort.close();
+        grbRXBuffer.Clear();
+        ui->statusBar->showMessage("Waiting for the next module...");
     }
-    gpSignalTimer->stop();
+    else
+    {
+        //Close the serial port
+        while (gspSerialPort.isOpen() == true)
+        {
+            gspSerialPort.clear();
+            gspSerialPort.close();
+        }
+        grbRXBuffer.Clear();
+        gbReplayPortOpen = false;
+        gpSignalTimer->stop();
 
-    //Change status message
-    ui->statusBar->showMessage("");
-    ui->label_TermConn->setText("[Port not open]");
+        //Change status message
+        ui->statusBar->showMessage("");
+        ui->label_TermConn->setText("[Port not open]");
+    }
 
     //Update images
     UpdateImages();
@@ -346,6 +794,12 @@ MainWindow::RefreshSerialDevices(
             }
             ++i;
         }
+
+        if (i == ui->combo_COM->count())
+        {
+            //Not enumerated (pseudo terminal or a port which has not appeared yet), keep it rather than falling back to the first port
+            ui->combo_COM->setCurrentText(strPrev);
+        }
     }
 
     //Update serial port info
@@ -358,124 +812,237 @@ void
 MainWindow::SerialRead(
     )
 {
-    //Read the data into a buffer and copy it to edit for the display data
-    QByteArray baOrigData = gspSerialPort.readAll();
+    //Data has arrived from the module
+    DtmTimelineScope dtsScope("SerialRead", "serial");
+    DtmLoopScope dlsScope(MetricsHandlerSerialRead);
+    ReadDevice(&gspSerialPort);
+}
 
-    //Update the display with the data
-    QByteArray baDispData = baOrigData;
+//=============================================================================
+//=============================================================================
+void
+MainWindow::ReadDevice(
+    QIODevice *pDevice
+    )
+{
+    //Read the data straight into the ring buffer and process it in place
+    while (grbRXBuffer.Fill(pDevice) > 0)
+    {
+        const char *pData;
+        qint64 intLength = grbRXBuffer.Peek(&pData);
+        while (intLength > 0)
+        {
+            gtwTraceWriter.Record(TraceRecordRX, pData, intLength);
+            ProcessSerialData(pData, intLength);
+            grbRXBuffer.Consume(intLength);
+            intLength = grbRXBuffer.Peek(&pData);
+        }
+    }
+}
 
-    //Replace unprintable characters
-    baDispData.replace('\0', "\\00").replace("\x01", "\\01").replace("\x02", "\\02").replace("\x03", "\\03").replace("\x04", "\\04").replace("\x05", "\\05").replace("\x06", "\\06").replace("\x07", "\\07").replace("\x08", "\\08").replace("\x0b", "\\0B").replace("\x0c", "\\0C").replace("\x0e", "\\0E").replace("\x0f", "\\0F").replace("\x10", "\\10").replace("\x11", "\\11").replace("\x12", "\\12").replace("\x13", "\\13").replace("\x14", "\\14").replace("\x15", "\\15").replace("\x16", "\\16").replace("\x17", "\\17").replace("\x18", "\\18").replace("\x19", "\\19").replace("\x1a", "\\1a").replace("\x1b", "\\1b").replace("\x1c", "\\1c").replace("\x1d", "\\1d").replace("\x1e", "\\1e").replace("\x1f", "\\1f");
+//=============================================================================
+//=============================================================================
+void
+MainWindow::ProcessSerialData(
+    const char *pData,
+    qint32 intLength
+    )
+{
+    //Update the display with the data
+    DtmTimelineScope dtsScope("ProcessSerialData", "serial", intLength);
 
-    //Update display buffer
+    //Update display buffer, replacing unprintable characters and dropping line endings
+    static const char strHexDigits[] = "0123456789ABCDEF";
+    TrimDisplayBuffer(intLength*3 + 4);
     gbaDisplayBuffer.append("> ");
-    gbaDisplayBuffer.append(QString(baDispData).replace("\r", "").replace("\n", ""));
+    qint32 i = 0;
+    while (i < intLength)
+    {
+        unsigned char chData = (unsigned char)pData[i];
+        if (chData >= 0x20 || chData == '\t')
+        {
+            gbaDisplayBuffer.append((char)chData);
+        }
+        else if (chData != '\r' && chData != '\n')
+        {
+            gbaDisplayBuffer.append('\\').append(strHexDigits[chData >> 4]).append(strHexDigits[chData & 0x0f]);
+        }
+        ++i;
+    }
     gbaDisplayBuffer.append("\r\n");
-    ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
-    ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
 
     //Update number of recieved bytes
-    gintRXBytes = gintRXBytes + baOrigData.length();
-    ui->label_TermRx->setText(QString::number(gintRXBytes));
+    gintRXBytes = gintRXBytes + intLength;
+    gdmMetrics.BytesReceived(intLength);
+    gsbStatusBlock.SetBytes(gintRXBytes, gintTXBytes);
+    if (isVisible() == true && gpDisplayTimer->isActive() == false)
+    {
+        //Redraw once the rest of this burst has arrived
+        gpDisplayTimer->start();
+    }
 
     if (gintProgramState != ProgramStatusIdle)
     {
-        //Currently waiting for a response
-        gstrTermBusyData = gstrTermBusyData.append(baOrigData);
-        gchTermBusyLines = gchTermBusyLines + baOrigData.count("\n");
+        //Currently waiting for a response, anything beyond the limit is noise so only the newest data is kept
+        if (gbaTermBusyData.length() + intLength > TermBusyDataLimit)
+        {
+            gbaTermBusyData.remove(0, gbaTermBusyData.length() + intLength - TermBusyDataLimit);
+        }
+        gbaTermBusyData.append(pData, intLength);
+        bool bLineEnd = false;
+        qint32 intResponseLength = 0;
+        i = 0;
+        while (i < intLength)
+        {
+            if (pData[i] == '\n')
+            {
+                ++gchTermBusyLines;
+            }
+            else if (pData[i] == '\r')
+            {
+                bLineEnd = true;
+            }
+            ++i;
+        }
 
-        if (gintProgramState == ProgramStatusEraseFS && gchTermBusyLines >= 2)
+        if (gintProgramState == ProgramStatusProbe && gbaTermBusyData.indexOf("\n00\r") != -1)
+        {
+            //Module is already in interactive mode
+            ModuleNotInDTM();
+        }
+        else if (gintProgramState == ProgramStatusBaudDetect && gbaTermBusyData.indexOf("\n00\r") != -1)
+        {
+            //Module responded at the candidate setting
+            BaudDetected();
+        }
+        else if (gintProgramState == ProgramStatusIdentify && bLineEnd == true && ResponseValue(gbaTermBusyData, "\n10\t0\t", &intResponseLength) != -1)
+        {
+            //Device type is queried last, so both responses are in
+            IdentifyModule();
+        }
+        else if (gintProgramState == ProgramStatusEraseFS && gchTermBusyLines >= 2)
         {
             //Check that module filesystem has been erased
-            if (gstrTermBusyData.indexOf("\nFFS Erased, Rebooting...") != -1 && gstrTermBusyData.indexOf("\n00\r", gstrTermBusyData.indexOf("\nFFS Erased, Rebooting...") + 1) != -1)
+            if (gbaTermBusyData.indexOf("\nFFS Erased, Rebooting...") != -1 && gbaTermBusyData.indexOf("\n00\r", gbaTermBusyData.indexOf("\nFFS Erased, Rebooting...") + 1) != -1)
             {
                 //Module has been erased - no longer in DTM mode
-                gstrTermBusyData.clear();
+                gbaTermBusyData.resize(0);
                 gchTermBusyLines = 0;
-                if (ui->check_License->isChecked())
+                ContinueAfterEscape();
+            }
+        }
+        else if (gintProgramState == ProgramStatusHighSpeed && bLineEnd == true)
+        {
+            //Responses to the timed queries or rate change, only checked once a line has ended. An error ends the step straight away
+            qint32 intError = gbaTermBusyData.indexOf("\n01");
+            if (intError != -1 && gbaTermBusyData.indexOf('\r', intError) != -1)
+            {
+                HighSpeedResponse(false);
+            }
+            else
+            {
+                quint8 intResponses = 0;
+                qint32 intPosition = gbaTermBusyData.indexOf("\n00\r");
+                while (intPosition != -1)
                 {
-                    //Optional license check
-                    gintProgramState = ProgramStatusLicenseCheck;
-
-                    //Check the license and BT address
-                    gspSerialPort.write("at i 4");
-                    DoLineEnd();
-                    gbaDisplayBuffer.append("< at i 4\n");
-                    gspSerialPort.write("at i 14");
-                    DoLineEnd();
-                    gbaDisplayBuffer.append("< at i 14\n");
-                    ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
-                    ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
+                    ++intResponses;
+                    intPosition = gbaTermBusyData.indexOf("\n00\r", intPosition + 1);
                 }
-                else
+                if (intResponses >= gintHighSpeedExpected)
                 {
-                    //No license check, finished
-                    ui->text_TermEditData->appendPlainText("License check not performed.");
-
-                    //Clean up
-                    gstrTermBusyData.clear();
-                    gchTermBusyLines = 0;
-                    gintProgramState = ProgramStatusIdle;
-                    gpSystemTimeout->stop();
-                    gbaDisplayBuffer.append("\r\n\r\n ~ DTM escape complete ~ \r\n");
-                    ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
-                    ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
-
-                    //Close port
-                    TermClose();
-
-                    //Show result
-                    if (gbExitOnFinish == true)
-                    {
-                        //License code is present and module is out of DTM
-                        QApplication::exit(ExitCodeOK);
-                    }
-                    else
-                    {
-                        //Show result on message box
-                        QMessageBox::information(this, "Exit DTM mode result", "Escape from DTM mode complete, you can now communicate with the module as required.\r\n\r\nYour module's license has been unchecked, and is ready for use.\r\n", QMessageBox::Close);
-                    }
+                    HighSpeedResponse(true);
                 }
             }
         }
-        else if (gintProgramState == ProgramStatusLicenseCheck && gchTermBusyLines == 4)
+        else if (gintProgramState == ProgramStatusLicenseInstall && bLineEnd == true && ResponseCount(gbaTermBusyData) >= 1)
+        {
+            //License written (or rejected), check it again
+            gbaTermBusyData.resize(0);
+            gchTermBusyLines = 0;
+            StartLicenseCheck();
+        }
+        else if (gintProgramState == ProgramStatusLicenseCheck && bLineEnd == true && ResponseCount(gbaTermBusyData) >= 2)
         {
-            QRegularExpression reTempLicRE("\n10\t4\t00 ([a-zA-Z0-9]{12})\r\n00\r");
-            QRegularExpressionMatch remTempLicREM = reTempLicRE.match(gstrTermBusyData);
-            QString strResultData = "Escape from DTM mode complete, you can now communicate with the module as required.\r\n\r\n";
+            //Both at i 4 and at i 14 have finished, only the values which were read are converted
+            qint32 intLicenseLength = 0;
+            qint32 intLicense = ResponseValue(gbaTermBusyData, "\n10\t4\t", &intLicenseLength);
+            bool bLicenseRead = (intLicense != -1 && intLicenseLength == LicenseAddressLength + 3 && memcmp(gbaTermBusyData.constData() + intLicense, "00 ", 3) == 0 && IsAddress(gbaTermBusyData.constData() + intLicense + 3, intLicenseLength - 3) == true);
+            QString strLicense = (bLicenseRead == true ? QString::fromLatin1(gbaTermBusyData.constData() + intLicense + 3, intLicenseLength - 3) : QString());
+            qint32 intAddressLength = 0;
+            qint32 intAddress = ResponseValue(gbaTermBusyData, "\n10\t14\t", &intAddressLength);
+            bool bAddressRead = (intAddress != -1 && intAddressLength == LicenseAddressLength + 3 && gbaTermBusyData.at(intAddress) == '0' && gbaTermBusyData.at(intAddress + 1) >= '0' && gbaTermBusyData.at(intAddress + 1) <= '4' && gbaTermBusyData.at(intAddress + 2) == ' ' && IsAddress(gbaTermBusyData.constData() + intAddress + 3, intAddressLength - 3) == true);
+            QString strAddressType = (bAddressRead == true ? QString::fromLatin1(gbaTermBusyData.constData() + intAddress, 2) : QString());
+            QString strAddress = (bAddressRead == true ? QString::fromLatin1(gbaTermBusyData.constData() + intAddress + 3, intAddressLength - 3) : QString());
+            QString strResultData = (gbEscapeSkipped == true ? "Module was not in DTM mode, no escape or erase was needed.\r\n\r\n" : "Escape from DTM mode complete, you can now communicate with the module as required.\r\n\r\n");
             bool bLicenseValid = false;
-            if (remTempLicREM.hasMatch() == true && remTempLicREM.captured(1).toUpper() == "0016A4C0FFEE")
+            if (gstrDetectedSetting.length() > 0)
+            {
+                //Remember the detected setting against this unit
+                if (bAddressRead == true)
+                {
+                    gpPersistentSettings->setValue(QString("Units/").append(strAddress.toUpper()).append("/Setting"), gstrDetectedSetting);
+                    gpPersistentSettings->setValue(QString("AutoBaud/").append(ui->combo_COM->currentText()).append("/Unit"), strAddress.toUpper());
+                }
+            }
+            if (bLicenseRead == true && strLicense.toUpper() == LicensePlaceholder)
             {
                 //Invalid license detected
-                QRegularExpression reTempAddrRE("\n10\t14\t(00|01|02|03|04) ([a-zA-Z0-9]{12})\r\n00\r");
-                QRegularExpressionMatch remTempAddrREM = reTempAddrRE.match(gstrTermBusyData);
+                if (gbLicenseInstalled == false && bAddressRead == true)
+                {
+                    QByteArray baLicense = glsLicenseStore.Lookup(strAddress);
+                    if (baLicense.length() > 0)
+                    {
+                        //License is in the key file, install it and check again
+                        gbaTermBusyData.resize(0);
+                        gchTermBusyLines = 0;
+                        StartLicenseInstall(baLicense);
+                        return;
+                    }
+                }
                 strResultData.append("Your module does not have a valid license, you will need to send the response to the command 'at i 14' to Laird support for them to generate you a license.\r\n");
-                if (remTempAddrREM.hasMatch() == true)
+                if (bAddressRead == true)
                 {
                     //We have an address to return
-                    strResultData.append("\r\nAT I 14 response from this module: ").append(remTempAddrREM.captured(2)).append(".\r\n");
+                    strResultData.append("\r\nAT I 14 response from this module: ").append(strAddress).append(".\r\n");
                 }
                 ui->text_TermEditData->appendPlainText("License check: bad key.");
+                gsbStatusBlock.SetLicense(StatusLicenseMissing);
             }
-            else if (remTempLicREM.hasMatch() == true && remTempLicREM.captured(1).toUpper() == "0016A4C0FFEE")
+            else if (bLicenseRead == true)
             {
                 //Valid license detected
-                strResultData.append("Your module has a valid license (").append(remTempLicREM.captured(1).toUpper()).append(") and is ready for use.\r\n");
+                if (gbLicenseInstalled == true)
+                {
+                    strResultData.append("A license from the key file has been installed.\r\n");
+                }
+                strResultData.append("Your module has a valid license (").append(strLicense.toUpper()).append(") and is ready for use.\r\n");
                 ui->text_TermEditData->appendPlainText("License check: good key.");
+                gsbStatusBlock.SetLicense(gbLicenseInstalled == true ? StatusLicenseInstalled : StatusLicenseValid);
                 bLicenseValid = true;
             }
 
+            if (DtmEvent::IsEnabled() == true)
+            {
+                //Values read from the module, as soon as they are known
+                DtmEvent("module").Add("license", (bLicenseRead == true ? strLicense.toUpper() : QString())).Add("license_valid", bLicenseValid).Add("license_installed", gbLicenseInstalled).Add("address_type", (bAddressRead == true ? strAddressType : QString())).Add("address", (bAddressRead == true ? strAddress.toUpper() : QString())).Add("escape_skipped", gbEscapeSkipped).Emit();
+            }
+
             //Clean up
-            gstrTermBusyData.clear();
+            gbaTermBusyData.resize(0);
             gchTermBusyLines = 0;
-            gintProgramState = ProgramStatusIdle;
+            SetProgramState(ProgramStatusIdle);
+            if (gbEscapeSkipped == false)
+            {
+                gdmMetrics.EscapeCompleted(gtmrEscape.nsecsElapsed());
+            }
             gpSystemTimeout->stop();
-            gbaDisplayBuffer.append("\r\n\r\n ~ DTM escape complete ~ \r\n");
+            gbaDisplayBuffer.append(gbEscapeSkipped == true ? "\r\n\r\n ~ Module was not in DTM mode, no escape needed ~ \r\n" : "\r\n\r\n ~ DTM escape complete ~ \r\n");
             ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
             ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
 
             //Close port
             TermClose();
+            RecordResult(bLicenseValid == true ? ExitCodeOK : ExitCodeLicenseMissing);
 
             //Show result
             if (gbExitOnFinish == true)
@@ -492,7 +1059,7 @@ MainWindow::SerialRead(
                     QApplication::exit(ExitCodeLicenseMissing);
                 }
             }
-            else
+            else if (gintPoolTrigger == PoolTriggerNone)
             {
                 //Show result on message box
                 QMessageBox::information(this, "Exit DTM mode result", strResultData, QMessageBox::Close);
@@ -501,6 +1068,38 @@ MainWindow::SerialRead(
     }
 }
 
+//=============================================================================
+//=============================================================================
+void
+MainWindow::RefreshDisplay(
+    )
+{
+    //Redraws the terminal with everything received since the last redraw
+    if (isVisible() == true)
+    {
+        ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
+        ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
+        ui->label_TermRx->setText(QString::number(gintRXBytes));
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::TrimDisplayBuffer(
+    qint32 intIncoming
+    )
+{
+    //Drops the oldest lines so the display buffer stays within its reserved capacity and never reallocates
+    if (gbaDisplayBuffer.length() + intIncoming <= DisplayBufferReserve)
+    {
+        return;
+    }
+    qint32 intCut = gbaDisplayBuffer.length() + intIncoming - DisplayBufferReserve/2;
+    qint32 intLineEnd = gbaDisplayBuffer.indexOf('\n', intCut);
+    gbaDisplayBuffer.remove(0, (intLineEnd == -1 ? intCut : intLineEnd + 1));
+}
+
 //=============================================================================
 //=============================================================================
 void
@@ -508,7 +1107,7 @@ MainWindow::UpdateImages(
     )
 {
     //Updates images to reflect status
-    if (gspSerialPort.isOpen() == true)
+    if (SerialIsOpen() == true)
     {
         //Port open
         SerialStatus(true);
@@ -521,8 +1120,8 @@ void
 MainWindow::DoLineEnd(
     )
 {
-    //Outputs a line ending - CR
-    gspSerialPort.write("\r");
+    //Ends the queued command with a line ending - CR, sent at the next flush
+    gbaTXQueue.append('\r');
     return;
 }
 
@@ -533,10 +1132,18 @@ MainWindow::SerialStatus(
     bool bType
     )
 {
-    if (gspSerialPort.isOpen() == true)
+    DtmTimelineScope dtsScope("SerialStatus", "signals");
+    DtmLoopScope dlsScope(MetricsHandlerSerialStatus);
+    if (SerialIsOpen() == true)
     {
-        unsigned int intSignals = gspSerialPort.pinoutSignals();
-        if ((((intSignals & QSerialPort::ClearToSendSignal) == QSerialPort::ClearToSendSignal ? 1 : 0) != gbCTSStatus || bType == true))
+        unsigned int intSignals = SerialSignals();
+        if (gtwTraceWriter.IsOpen() == true && (intSignals != gintTraceSignals || bType == true))
+        {
+            //Record change of modem lines
+            gintTraceSignals = intSignals;
+            gtwTraceWriter.RecordSignals(intSignals);
+        }
+        if ((((intSignals & QSerialPort::ClearToSendSignal) == QSerialPort::ClearToSendSignal ? 1 : 0) != gbCTSStatus || bType == true))
         {
             //CTS changed
             gbCTSStatus = ((intSignals & QSerialPort::ClearToSendSignal) == QSerialPort::ClearToSendSignal ? 1 : 0);
@@ -550,20 +1157,17 @@ MainWindow::SerialStatus(
                 //Waiting for module to exit DTM and return to interactive mode
                 if (gbCTSStatus == 1)
                 {
-                    //Module has reset in normal mode, let's re-open the UART at the normal settings
-                    gintProgramState = ProgramStatusEraseFS;
-                    OpenDevice((QSerialPort::BaudRate)ui->combo_Baud->currentText().toUInt(), (ui->combo_Handshake->currentIndex() == 2 ? QSerialPort::SoftwareControl : (ui->combo_Handshake->currentIndex() == 1 ? QSerialPort::HardwareControl : QSerialPort::NoFlowControl)));
-
-                    //Send the clear configuration command
-                    DoLineEnd(); //In case module was not in DTM and has received garbage command
-                    gspSerialPort.write("at&f*");
-                    DoLineEnd();
-                    gbaDisplayBuffer.append("< at&f*\n");
-                    ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
-                    ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
+                    //Module has reset in normal mode
+                    gdmMetrics.CTSWait(gtmrExitSent.nsecsElapsed());
+                    ModuleExitedDTM();
                 }
             }
         }
+        else if (gintPoolTrigger != PoolTriggerNone && gbReplayActive == false && gpHubWaitTimer->isActive() == false)
+        {
+            //Pooled port is idle, look for the next module
+            PoolCheckUnit(intSignals);
+        }
     }
     else
     {
@@ -592,7 +1196,9 @@ MainWindow::OpenDevice(
     )
 {
     //Function to open serial port
-    if (gspSerialPort.isOpen() == true)
+    DtmTimelineScope dtsScope("OpenDevice", "port", spbBaud);
+    bool bKeepOpen = (gintPoolTrigger != PoolTriggerNone && gbReplayActive == false && gspSerialPort.isOpen() == true && gspSerialPort.portName() == ui->combo_COM->currentText());
+    if (SerialIsOpen() == true && bKeepOpen == false)
     {
         //Close serial port
         while (gspSerialPort.isOpen() == true)
@@ -600,6 +1206,9 @@ MainWindow::OpenDevice(
             gspSerialPort.clear();
             gspSerialPort.close();
         }
+        gbReplayPortOpen = false;
+        gintTXPending = 0;
+        gdmMetrics.TXPending(0);
         gpSignalTimer->stop();
 
         //Change status message
@@ -609,7 +1218,7 @@ MainWindow::OpenDevice(
         UpdateImages();
     }
 
-    if (ui->combo_COM->currentText().length() > 0)
+    if (gbReplayActive == true || ui->combo_COM->currentText().length() > 0)
     {
         //Port selected: setup serial port
         gspSerialPort.setPortName(ui->combo_COM->currentText());
@@ -622,10 +1231,32 @@ MainWindow::OpenDevice(
         //Disable showing errors until open was successful
         gbShowSerialErrors = false;
 
-        if (gspSerialPort.open(QIODevice::ReadWrite))
+        bool bOpened;
+        if (gbReplayActive == true)
+        {
+            //Replaying a trace, no serial port is used
+            gbReplayPortOpen = true;
+            bOpened = true;
+        }
+        else if (bKeepOpen == true)
+        {
+            //Pooled port is already open and has been reconfigured above, discard anything received before now
+            bOpened = (gspSerialPort.baudRate() == spbBaud && gspSerialPort.flowControl() == spfFlow);
+            gspSerialPort.clear();
+            grbRXBuffer.Clear();
+            gintTXPending = 0;
+            gdmMetrics.TXPending(0);
+        }
+        else
+        {
+            bOpened = gspSerialPort.open(QIODevice::ReadWrite);
+        }
+
+        if (bOpened == true)
         {
             //Successful
-            ui->statusBar->showMessage(QString("[").append(ui->combo_COM->currentText()).append(":").append(ui->combo_Baud->currentText()).append(",").append((ui->combo_Handshake->currentIndex() == 0 ? "N" : ui->combo_Handshake->currentIndex() == 1 ? "H" : ui->combo_Handshake->currentIndex() == 2 ? "S" : "")).append("]{").append("cr").append("}"));
+            gtwTraceWriter.RecordOpen(spbBaud, spfFlow);
+            ui->statusBar->showMessage(QString("[").append(ui->combo_COM->currentText()).append(":").append(QString::number(spbBaud)).append(",").append((spfFlow == QSerialPort::NoFlowControl ? "N" : spfFlow == QSerialPort::HardwareControl ? "H" : spfFlow == QSerialPort::SoftwareControl ? "S" : "")).append("]{").append("cr").append("}"));
             ui->label_TermConn->setText(ui->statusBar->currentMessage());
 
             //Show serial errors
@@ -640,11 +1271,14 @@ MainWindow::OpenDevice(
             //Signal checking
             SerialStatus(1);
 
-            if (spbBaud == DTMBaudRate && spfFlow == DTMFlowControl)
+            if (gintProgramState == ProgramStatusIdle && spbBaud == DTMBaudRate && spfFlow == DTMFlowControl)
             {
                 //First stage of program
-                gintProgramState = ProgramStatusExitDTM;
+                gbEscapeSkipped = false;
+                SetProgramState(ProgramStatusExitDTM);
                 gpSystemTimeout->start(ModuleTimeout);
+                gdmMetrics.EscapeStarted();
+                gtmrEscape.start();
             }
 
 #ifndef TARGET_OS_MAC
@@ -653,6 +1287,7 @@ MainWindow::OpenDevice(
             {
                 //CTS not deasserted as expected. Close port
                 TermClose();
+                RecordResult(ExitCodeCTSAsserted);
 
                 if (gbExitOnFinish == true)
                 {
@@ -662,7 +1297,7 @@ MainWindow::OpenDevice(
                     gpExitTimer->start();
                     return;
                 }
-                else
+                else if (gintPoolTrigger == PoolTriggerNone)
                 {
                     //Show error
                     QMessageBox::warning(this, "Error: CTS is asserted", "CTS should not be asserted whilst in DTM mode, aborting...", QMessageBox::Ok);
@@ -672,7 +1307,7 @@ MainWindow::OpenDevice(
 #endif
 
             //Start signal timer
-            gpSignalTimer->start(100);
+            gpSignalTimer->start(gintSignalPollInterval);
 
             //Change to terminal tab
             ui->selector_Tab->setCurrentIndex(ui->selector_Tab->indexOf(ui->tab_Disp));
@@ -682,21 +1317,22 @@ MainWindow::OpenDevice(
 
             if (gintProgramState == ProgramStatusExitDTM)
             {
-                //Generate the exit DTM command
-                QByteArray baExitDTM;
-                baExitDTM.append(DTMExitCMDA);
-                baExitDTM.append(DTMExitCMDB);
-
-                //Send the exit DTM command
-                gspSerialPort.write(baExitDTM);
                 if (gbaDisplayBuffer.count() > 0)
                 {
                     //Line break
                     gbaDisplayBuffer.append("-------------------------\r\n\r\n");
                 }
-                gbaDisplayBuffer.append("< \\3F\\FF\n");
-                ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
-                ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
+
+                //Send the exit DTM command
+                gintExitAttempts = 1;
+                SendExitDTM();
+
+                if (gintRetryMaxAttempts > 0)
+                {
+                    //Resend the command if the module does not respond in time
+                    gintRetryInterval = gintRetryInitialInterval;
+                    gpRetryTimer->start(gintRetryInterval);
+                }
 
 #ifdef TARGET_OS_MAC
                 //Workaround for mac
@@ -709,12 +1345,18 @@ MainWindow::OpenDevice(
             //Error whilst opening
             ui->statusBar->showMessage("Error: ");
             ui->statusBar->showMessage(ui->statusBar->currentMessage().append(gspSerialPort.errorString()));
+            if (gintProgramState == ProgramStatusBaudDetect || gintProgramState == ProgramStatusHighSpeed)
+            {
+                //Setting not supported by the serial device, the caller moves on
+                return;
+            }
             QString strMessage = QString("Error whilst attempting to open the serial device: ").append(gspSerialPort.errorString()).append("\n\nIf the serial port is open in another application, please close the other application")
 #if !defined(_WIN32) && !defined( __APPLE__)
             .append(", please also ensure you have been granted permission to the serial device in /dev/")
 #endif
             .append((ui->combo_Baud->currentText().toULong() > 115200 ? ", please also ensure that your serial device supports baud rates greater than 115200 (normal COM ports do not have support for these baud rates)" : ""))
             .append(" and try again.");
+            RecordResult(ExitCodeInvalidPort);
 
             if (gbExitOnFinish == true)
             {
@@ -731,6 +1373,7 @@ MainWindow::OpenDevice(
     else
     {
         //No serial port selected
+        RecordResult(ExitCodeInvalidPort);
         if (gbExitOnFinish == true)
         {
             //Close application with error
@@ -751,6 +1394,7 @@ MainWindow::SerialError(
     QSerialPort::SerialPortError speErrorCode
     )
 {
+    DtmLoopScope dlsScope(MetricsHandlerSerialError);
     if (speErrorCode == QSerialPort::NoError)
     {
         //No error. Why this is ever emitted is a mystery to me.
@@ -764,6 +1408,8 @@ MainWindow::SerialError(
             //Close active connection
             gspSerialPort.close();
         }
+        gdmMetrics.USBReset();
+        RecordResult(ExitCodeSerialPortError);
 
         //Change status message
         ui->statusBar->showMessage("");
@@ -780,9 +1426,15 @@ MainWindow::SerialError(
         else
         {
             //Set back to idle
-            gintProgramState = ProgramStatusIdle;
+            SetProgramState(ProgramStatusIdle);
             gpSystemTimeout->stop();
             gpSignalTimer->stop();
+            gpRetryTimer->stop();
+            gpResetPulseTimer->stop();
+            gpBaudProbeTimer->stop();
+            gpVerifyTimer->stop();
+            gpHighSpeedTimer->stop();
+            gpIdentifyTimer->stop();
 
 #ifdef TARGET_OS_MAC
         gpMacDoesntSupportCTSWorkaroundTimer->stop();
@@ -816,7 +1468,16 @@ MainWindow::SerialBytesWritten(
 {
     //Updates the display with the number of bytes written
     gintTXBytes += intByteCount;
+    gintTXPending = (intByteCount < gintTXPending ? gintTXPending - intByteCount : 0);
+    gdmMetrics.TXPending(gintTXPending);
+    gsbStatusBlock.SetBytes(gintRXBytes, gintTXBytes);
+    gdmMetrics.BytesSent(intByteCount);
     ui->label_TermTx->setText(QString::number(gintTXBytes));
+    if (gintTXPending == 0 && gintProgramState == ProgramStatusHighSpeed && gintHighSpeedStep == HighSpeedStepDrain)
+    {
+        //Revert command has gone, the host can follow the module back
+        HighSpeedRevertHost();
+    }
 }
 
 //=============================================================================
@@ -876,8 +1537,8 @@ void
 MainWindow::on_btn_TermClear_clicked(
     )
 {
-    //Clears display buffer
-    gbaDisplayBuffer.clear();
+    //Clears display buffer (keeping its reserved capacity)
+    gbaDisplayBuffer.resize(0);
     ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
 }
 
@@ -888,26 +1549,30 @@ MainWindow::SystemTimeout(
     )
 {
     //Occurs when there is a timeout waiting for a response
-    QString strMessage = QString("Unfortunately, an error has occured whilst attempting to exit DTM mode on the attached module. Are you sure this module is a valid BL654 device and has the UART pins (and nRESET) wired correctly? Are you sure ").append(ui->combo_COM->currentText()).append(" is the correct serial port for this device? Are you sure there is a valid firmware image loaded to the module? Are you sure the provided serial settings (Baud rate: ").append(ui->combo_Baud->currentText()).append(", Handshaking: ").append(ui->combo_Handshake->currentText()).append(") is correct?\r\n\r\nPlease detail your setup and attach this message as a screenshot when you contact support for further assistance.\r\n\r\nProcess ID: ").append(QString::number(gintProgramState)).append(" CTS: ").append(QString::number(gbCTSStatus)).append(", Lines: ").append(QString::number(gchTermBusyLines)).append(", BufferA: ").append(gstrTermBusyData).append(", BufferB: ").append(gbaDisplayBuffer);
+    DtmTimelineScope dtsScope("SystemTimeout", "timer");
+    DtmLoopScope dlsScope(MetricsHandlerSystemTimeout);
+    QString strMessage = QString("Unfortunately, an error has occured whilst attempting to exit DTM mode on the attached module. Are you sure this module is a valid BL654 device and has the UART pins (and nRESET) wired correctly? Are you sure ").append(ui->combo_COM->currentText()).append(" is the correct serial port for this device? Are you sure there is a valid firmware image loaded to the module? Are you sure the provided serial settings (Baud rate: ").append(ui->combo_Baud->currentText()).append(", Handshaking: ").append(ui->combo_Handshake->currentText()).append(") is correct?\r\n\r\nPlease detail your setup and attach this message as a screenshot when you contact support for further assistance.\r\n\r\nProcess ID: ").append(QString::number(gintProgramState)).append(" CTS: ").append(QString::number(gbCTSStatus)).append(", Attempts: ").append(QString::number(gintExitAttempts)).append(", Lines: ").append(QString::number(gchTermBusyLines)).append(", BufferA: ").append(QString(gbaTermBusyData)).append(", BufferB: ").append(gbaDisplayBuffer);
     gpSystemTimeout->stop();
-    gintProgramState = ProgramStatusIdle;
+    SetProgramState(ProgramStatusIdle);
     gchTermBusyLines = 0;
-    gstrTermBusyData.clear();
-    gbaDisplayBuffer.clear();
+    gbaTermBusyData.resize(0);
+    gbaDisplayBuffer.resize(0);
 #ifdef TARGET_OS_MAC
     gpMacDoesntSupportCTSWorkaroundTimer->stop();
 #endif
 
     //Close serial port
     TermClose();
+    RecordResult(ExitCodeTimeout);
 
     //Check which mode to run
     if (gbExitOnFinish == true)
     {
-        //Exit application
-        QApplication::exit(ExitCodeTimeout);
+        //Exit application from the event loop, a replay which ends during start-up gets here before it is running
+        gintExitCode = ExitCodeTimeout;
+        gpExitTimer->start();
     }
-    else
+    else if (gintPoolTrigger == PoolTriggerNone)
     {
         //Show message
         QMessageBox::warning(this, "Error during DTM escape", strMessage, QMessageBox::Ok);
@@ -924,53 +1589,1626 @@ MainWindow::ForceClose(
     QApplication::exit(gintExitCode);
 }
 
-#ifdef TARGET_OS_MAC
 //=============================================================================
 //=============================================================================
 void
-MainWindow::ContinueOperationMacDoesntSupportCTSWorkaroundFunction(
+MainWindow::SendExitDTM(
     )
 {
-    //Workaround for mac
-    if (gintProgramState == ProgramStatusExitDTM)
+    //Generate the exit DTM command
+    QByteArray baExitDTM;
+    baExitDTM.append(DTMExitCMDA);
+    baExitDTM.append(DTMExitCMDB);
+
+    //Send the exit DTM command
+    SerialQueue(baExitDTM);
+    SerialFlush();
+    gtmrExitSent.start();
+    gbaDisplayBuffer.append("< \\3F\\FF\n");
+    ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
+    ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::SetResetLine(
+    bool bAsserted
+    )
+{
+    //Sets the state of the modem line which is wired to the module reset
+    if (gintResetLine == ResetLineDTR)
+    {
+        gspSerialPort.setDataTerminalReady(bAsserted);
+    }
+    else if (gintResetLine == ResetLineRTS)
     {
-        //We will just assume that the module has reset in normal mode, let's re-open the UART at the normal settings
-        gintProgramState = ProgramStatusEraseFS;
-        OpenDevice((QSerialPort::BaudRate)ui->combo_Baud->currentText().toUInt(), (ui->combo_Handshake->currentIndex() == 2 ? QSerialPort::SoftwareControl : (ui->combo_Handshake->currentIndex() == 1 ? QSerialPort::HardwareControl : QSerialPort::NoFlowControl)));
+        gspSerialPort.setRequestToSend(bAsserted);
+    }
+}
 
-        //Send the clear configuration command
-        DoLineEnd(); //In case module was not in DTM and has received garbage command
-        gspSerialPort.write("at&f*");
-        DoLineEnd();
-        gbaDisplayBuffer.append("< at&f*\n");
-        ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
-        ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
+//=============================================================================
+//=============================================================================
+void
+MainWindow::RetryExitDTM(
+    )
+{
+    //Module has not responded to the exit DTM command yet, send it again
+    DtmTimelineScope dtsScope("RetryExitDTM", "timer", gintExitAttempts);
+    DtmLoopScope dlsScope(MetricsHandlerRetryExitDTM);
+    if (gintProgramState != ProgramStatusExitDTM || SerialIsOpen() == false)
+    {
+        //No longer waiting for the module
+        return;
+    }
+
+    ++gintExitAttempts;
+    gdmMetrics.Retry();
+    if (gintResetLine != ResetLineNone)
+    {
+        //Reset the module first, the command is sent once the pulse has finished
+        SetResetLine(true);
+        gpResetPulseTimer->start();
+    }
+    else
+    {
+        //Send the command straight away
+        SendExitDTM();
+    }
+
+    if (gintExitAttempts <= gintRetryMaxAttempts)
+    {
+        //Back off exponentially before the next resend
+        gintRetryInterval = (gintRetryInterval*2 > DTMRetryMaxInterval ? DTMRetryMaxInterval : gintRetryInterval*2);
+        gpRetryTimer->start(gintRetryInterval);
     }
 }
-#endif
 
 //=============================================================================
 //=============================================================================
 void
-MainWindow::on_btn_Cancel_clicked(
+MainWindow::ResetPulseFinished(
     )
 {
-    //Cancel operation
-    TermClose();
-    ui->statusBar->showMessage("Operation cancelled!");
+    //Release the reset line and send the exit DTM command
+    if (SerialIsOpen() == true)
+    {
+        SetResetLine(false);
+        if (gintProgramState == ProgramStatusExitDTM)
+        {
+            SendExitDTM();
+        }
+    }
 }
 
 //=============================================================================
 //=============================================================================
 void
-MainWindow::on_btn_Help_clicked(
+MainWindow::SerialWrite(
+    const QByteArray &baData
     )
 {
-    //Open help file
-    if (QDesktopServices::openUrl(QUrl(QString("http://").append(ServerHost).append("/exitdtm_help.pdf"))) == false)
+    //Sends data to the module (or discards it whilst replaying a trace)
+    DtmTimelineScope dtsScope("SerialWrite", "serial", baData.length());
+    if (gintStartupFirstTX < 0)
     {
-        //Failed to open
-        QMessageBox::critical(this, "Error opening help file", QString("An error occured whilst attempting to open the online help file: http://").append(ServerHost).append("/exitdtm_help.pdf"), QMessageBox::Ok, QMessageBox::NoButton);
+        gintStartupFirstTX = gtmrProcessStart.nsecsElapsed();
+    }
+    gtwTraceWriter.Record(TraceRecordTX, baData.constData(), baData.length());
+    gdmMetrics.TXWrite();
+    gintTXPending += baData.length();
+    gdmMetrics.TXPending(gintTXPending);
+    if (gbReplayActive == true)
+    {
+        //Keep a copy to compare against the trace
+        gbaReplayActualTX.append(baData);
+        emit ReplayWrite(baData);
+        SerialBytesWritten(baData.length());
+    }
+    else
+    {
+        gspSerialPort.write(baData);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::SerialQueue(
+    const QByteArray &baData
+    )
+{
+    //Adds a command to the TX queue, nothing is sent until the queue is flushed. Line endings are queued
+    //separately (DoLineEnd), so bare line endings sent to clear garbage are not counted as commands
+    gbaTXQueue.append(baData);
+    gdmMetrics.TXCommand();
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::SerialFlush(
+    )
+{
+    //Sends everything queued (a command, its line ending and any pipelined commands) in a single write
+    if (gbaTXQueue.length() > 0)
+    {
+        SerialWrite(gbaTXQueue);
+        gbaTXQueue.resize(0);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+bool
+MainWindow::SerialIsOpen(
+    )
+{
+    //Returns true if the serial port (or the replayed port) is open
+    return (gbReplayActive == true ? gbReplayPortOpen : gspSerialPort.isOpen());
+}
+
+//=============================================================================
+//=============================================================================
+quint32
+MainWindow::SerialSignals(
+    )
+{
+    //Returns the state of the modem lines (or the replayed state)
+    return (gbReplayActive == true ? gintReplaySignals : (quint32)gspSerialPort.pinoutSignals());
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::StartReplay(
+    const QString &strFilename
+    )
+{
+    //Starts feeding a trace file through the state machine
+    if (gtrTraceReader.Open(strFilename) == false)
+    {
+        RecordResult(ExitCodeInvalidTrace);
+        if (gbExitOnFinish == true)
+        {
+            //Exit with error code
+            gintExitCode = ExitCodeInvalidTrace;
+            gpExitTimer->start();
+        }
+        else
+        {
+            //Show error
+            QMessageBox::warning(this, "Error opening trace", QString("Unable to open trace file: ").append(strFilename), QMessageBox::Ok);
+        }
+        return;
+    }
+
+    //Start with the modem lines as they were when the trace was captured
+    gbReplayActive = true;
+    gintReplaySignals = 0;
+    gtrTraceReader.FirstSignals(&gintReplaySignals);
+    gbaReplayExpectedTX.clear();
+    gbaReplayActualTX.clear();
+    ui->label_TermConn->setText(QString("[Replay: ").append(strFilename).append("]"));
+
+    OpenDevice(DTMBaudRate, DTMFlowControl);
+
+    if (gtrTraceReader.Next(&gdtrReplayRecord) == true)
+    {
+        //Schedule the first record
+        gpReplayTimer->start((gbReplayRealTime == true || DtmClock::IsVirtual() == true) ? gdtrReplayRecord.intDelta/1000 : 0);
+    }
+    else
+    {
+        //Empty trace
+        FinishReplay();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::ReplayStep(
+    )
+{
+    DtmLoopScope dlsScope(MetricsHandlerReplayStep);
+    //Feeds the next record of the trace through the state machine
+    if (gbReplayActive == false)
+    {
+        return;
+    }
+
+    if (gdtrReplayRecord.intType == TraceRecordRX)
+    {
+        //Data received from the module
+        if (gbReplayPortOpen == true)
+        {
+            ProcessSerialData(gdtrReplayRecord.baData.constData(), gdtrReplayRecord.baData.length());
+        }
+    }
+    else if (gdtrReplayRecord.intType == TraceRecordSignals && gdtrReplayRecord.baData.length() == 4)
+    {
+        //Modem lines changed, check them straight away rather than waiting for the signal timer
+        gintReplaySignals = qFromLittleEndian<quint32>((const uchar *)gdtrReplayRecord.baData.constData());
+        SerialStatus(false);
+    }
+    else if (gdtrReplayRecord.intType == TraceRecordTX)
+    {
+        //Data sent during the capture
+        gbaReplayExpectedTX.append(gdtrReplayRecord.baData);
+    }
+
+    if (gbReplayActive == true && gtrTraceReader.Next(&gdtrReplayRecord) == true)
+    {
+        //Schedule the next record
+        gpReplayTimer->start((gbReplayRealTime == true || DtmClock::IsVirtual() == true) ? gdtrReplayRecord.intDelta/1000 : 0);
+    }
+    else
+    {
+        //End of trace
+        FinishReplay();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::FinishReplay(
+    )
+{
+    //Reports how the replay compared to the capture
+    if (gbaReplayExpectedTX == gbaReplayActualTX)
+    {
+        gbaDisplayBuffer.append("[Replay finished: sent data matches trace]\n");
+    }
+    else
+    {
+        gbaDisplayBuffer.append(QString("[Replay finished: sent data differs from trace, expected ").append(QString::number(gbaReplayExpectedTX.length())).append(" bytes, sent ").append(QString::number(gbaReplayActualTX.length())).append(" bytes]\n"));
+    }
+    ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
+    ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
+    gtrTraceReader.Close();
+
+    if (gintProgramState != ProgramStatusIdle && gbReplayRealTime == false && DtmClock::IsVirtual() == false)
+    {
+        //Trace ended before the escape completed, this would have timed out (in virtual time the timeout itself fires)
+        SystemTimeout();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::SetProgramState(
+    quint8 intState
+    )
+{
+    //Moves the state machine on, recording how long the previous stage took
+    if (DtmEvent::IsEnabled() == true && gintProgramState != intState)
+    {
+        DtmEvent("stage").Add("from", DtmMetrics::StageName(gintProgramState)).Add("to", DtmMetrics::StageName(intState)).Add("elapsed_ms", (qint64)(gintProgramState != ProgramStatusIdle ? gtmrStage.elapsed() : 0)).Emit();
+    }
+    if (gintProgramState != ProgramStatusIdle && gintProgramState != intState)
+    {
+        gdmMetrics.StageCompleted(gintProgramState, gtmrStage.nsecsElapsed());
+        gphPortHealth.StageCompleted(gintProgramState, gtmrStage.nsecsElapsed());
+    }
+    TimelineStage(gintProgramState, intState);
+    gintProgramState = intState;
+    gtmrStage.start();
+    gsbStatusBlock.SetState(intState);
+    if (gintResultSlot >= 0 && intState != ProgramStatusIdle)
+    {
+        //Idle is published along with the result by RecordResult, which may already have run
+        grtResultTable.Publish(gintResultSlot, intState, ResultPending);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::TimelineStage(
+    quint8 intFrom,
+    quint8 intTo
+    )
+{
+    //Records a change of program state on the timeline
+    if (DtmTimeline::IsEnabled() == true && intFrom != intTo)
+    {
+        if (intFrom != ProgramStatusIdle && DtmMetrics::StageName(intFrom) != NULL)
+        {
+            DtmTimeline::Record(DtmMetrics::StageName(intFrom), "stage", TimelinePhaseAsyncEnd);
+        }
+        if (intTo != ProgramStatusIdle && DtmMetrics::StageName(intTo) != NULL)
+        {
+            DtmTimeline::Record(DtmMetrics::StageName(intTo), "stage", TimelinePhaseAsyncBegin);
+        }
+    }
+}
+
+//=============================================================================
+//=============================================================================
+bool
+MainWindow::eventFilter(
+    QObject *pObject,
+    QEvent *pEvent
+    )
+{
+    //Marks repaints of the terminal on the timeline
+    if (pEvent->type() == QEvent::Paint)
+    {
+        DtmTimeline::Record("Repaint", "ui", TimelinePhaseInstant);
+    }
+    return QMainWindow::eventFilter(pObject, pEvent);
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::RecordResult(
+    int intExitCode
+    )
+{
+    //Records the outcome of an escape
+    if (DtmEvent::IsEnabled() == true)
+    {
+        DtmEvent("result").Add("code", (qint64)intExitCode).Add("result", DtmMetrics::ResultName(intExitCode)).Add("elapsed_ms", (qint64)(gtmrEscape.isValid() == true ? gtmrEscape.elapsed() : 0)).Emit();
+    }
+    gdmMetrics.Result(intExitCode);
+    gphPortHealth.Result(intExitCode);
+    if (gphPortHealth.IsDrifting() == true)
+    {
+        //Let maintenance know before the port starts failing
+        gbaDisplayBuffer.append(QString("[Port health: ").append(gphPortHealth.Reason()).append(gphPortHealth.IsQuarantined() == true ? ", quarantined" : "").append("]\r\n").toUtf8());
+    }
+    WriteMetrics();
+    gsbStatusBlock.SetResult(intExitCode);
+    gsbStatusBlock.SetState(ProgramStatusIdle);
+    if (gintResultSlot >= 0)
+    {
+        grtResultTable.Publish(gintResultSlot, ProgramStatusIdle, intExitCode);
+    }
+
+    //Free the hub slot for the next instance
+    gpHubWaitTimer->stop();
+    gpHubStaggerTimer->stop();
+    if (ghsHubScheduler.Release(intExitCode, (gtmrEscape.isValid() ? gtmrEscape.elapsed() : 0)) == false)
+    {
+        //Another instance is updating the hub state, retry rather than block the event loop
+        gpHubWaitTimer->start();
+    }
+
+    if (gintPoolTrigger != PoolTriggerNone)
+    {
+        //The next module is only started once this one has been removed
+        gbPoolArmed = false;
+        gtmrPoolSettle.invalidate();
+        ui->statusBar->showMessage(QString("Module finished (").append(QString::number(intExitCode)).append("), waiting for the next module..."));
+    }
+
+    //Outcome for anything driving the window (such as the tests)
+    emit EscapeFinished(intExitCode);
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::WriteMetrics(
+    )
+{
+    //Writes the metrics file if enabled
+    if (gstrMetricsFile.length() > 0)
+    {
+        gdmMetrics.Write(gstrMetricsFile, gphPortHealth.PrometheusText());
+    }
+}
+
+//=============================================================================
+//=============================================================================
+QSerialPort::BaudRate
+MainWindow::UserBaudRate(
+    )
+{
+    //Returns the baud rate selected for interactive mode
+    return (QSerialPort::BaudRate)ui->combo_Baud->currentText().toUInt();
+}
+
+//=============================================================================
+//=============================================================================
+QSerialPort::FlowControl
+MainWindow::UserFlowControl(
+    )
+{
+    //Returns the flow control selected for interactive mode
+    return (ui->combo_Handshake->currentIndex() == 2 ? QSerialPort::SoftwareControl : (ui->combo_Handshake->currentIndex() == 1 ? QSerialPort::HardwareControl : QSerialPort::NoFlowControl));
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::ModuleExitedDTM(
+    )
+{
+    //Module has reset in normal mode, move on to talking to it in interactive mode
+    gpRetryTimer->stop();
+    gpResetPulseTimer->stop();
+    if (gintExitAttempts > 1)
+    {
+        //Record how many attempts this module needed
+        gbaDisplayBuffer.append(QString("[Exited DTM after ").append(QString::number(gintExitAttempts)).append(" attempts]\n"));
+    }
+
+    gstrDetectedSetting.clear();
+    if (gbAutoBaud == true)
+    {
+        //Find the setting the module is using
+        StartBaudDetect();
+    }
+    else
+    {
+        //Re-open the UART at the normal settings
+        StartIdentify(UserBaudRate(), UserFlowControl());
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::StartEraseFS(
+    QSerialPort::BaudRate spbBaud,
+    QSerialPort::FlowControl spfFlow
+    )
+{
+    //Re-opens the UART (unless already open at these settings) and sends the clear configuration command
+    SetProgramState(ProgramStatusEraseFS);
+    if (SerialIsOpen() == false || gspSerialPort.baudRate() != spbBaud || gspSerialPort.flowControl() != spfFlow)
+    {
+        OpenDevice(spbBaud, spfFlow);
+    }
+
+    //Send the clear configuration command
+    DoLineEnd(); //In case module was not in DTM and has received garbage command
+    SerialQueue("at&f*");
+    DoLineEnd();
+    SerialFlush();
+    gbaDisplayBuffer.append("< at&f*\n");
+    ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
+    ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::StartIdentify(
+    QSerialPort::BaudRate spbBaud,
+    QSerialPort::FlowControl spfFlow
+    )
+{
+    //Queries the firmware version and device type before anything is erased, skipped without an allow-list
+    if (gslAllowedFirmware.count() == 0 && gslAllowedTypes.count() == 0)
+    {
+        StartEraseFS(spbBaud, spfFlow);
+        return;
+    }
+
+    SetProgramState(ProgramStatusIdentify);
+    gintIdentifyBaud = spbBaud;
+    gintIdentifyFlow = spfFlow;
+    if (SerialIsOpen() == false || gspSerialPort.baudRate() != spbBaud || gspSerialPort.flowControl() != spfFlow)
+    {
+        OpenDevice(spbBaud, spfFlow);
+    }
+    gbaTermBusyData.resize(0);
+    gchTermBusyLines = 0;
+
+    //Both queries go out in one write, after a line ending to clear any garbage command
+    DoLineEnd();
+    SerialQueue(IdentifyFirmwareQuery);
+    DoLineEnd();
+    SerialQueue(IdentifyTypeQuery);
+    DoLineEnd();
+    SerialFlush();
+    gbaDisplayBuffer.append("< ").append(IdentifyFirmwareQuery).append("\n< ").append(IdentifyTypeQuery).append("\n");
+    ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
+    ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
+    gpIdentifyTimer->start();
+}
+
+//=============================================================================
+//=============================================================================
+bool
+MainWindow::IdentityAllowed(
+    const QStringList &slAllowed,
+    const QString &strValue
+    )
+{
+    //True if the list is empty or has the value (a trailing * matches any suffix), case insensitive
+    if (slAllowed.count() == 0)
+    {
+        return true;
+    }
+    int i = 0;
+    while (i < slAllowed.count())
+    {
+        QString strAllowed = slAllowed[i].trimmed().toUpper();
+        if (strAllowed.length() > 0 && (strAllowed.right(1) == "*" ? strValue.toUpper().startsWith(strAllowed.left(strAllowed.length()-1)) : strValue.toUpper() == strAllowed))
+        {
+            return true;
+        }
+        ++i;
+    }
+    return false;
+}
+
+//=============================================================================
+//=============================================================================
+qint32
+MainWindow::ResponseValue(
+    const QByteArray &baData,
+    const char *strPrefix,
+    qint32 *pintLength
+    )
+{
+    //Finds a complete "<prefix><value>\r\n00\r" response in the received bytes, returning the start of the value (or -1) without converting the data
+    qint32 intPrefixLength = (qint32)strlen(strPrefix);
+    qint32 intPosition = baData.indexOf(strPrefix);
+    while (intPosition != -1)
+    {
+        qint32 intStart = intPosition + intPrefixLength;
+        qint32 intEnd = baData.indexOf('\r', intStart);
+        if (intEnd == -1)
+        {
+            //Value has not ended yet
+            return -1;
+        }
+        if (intEnd + 5 <= baData.length() && memcmp(baData.constData() + intEnd, "\r\n00\r", 5) == 0)
+        {
+            *pintLength = intEnd - intStart;
+            return intStart;
+        }
+        intPosition = baData.indexOf(strPrefix, intPosition + 1);
+    }
+    return -1;
+}
+
+//=============================================================================
+//=============================================================================
+quint8
+MainWindow::ResponseCount(
+    const QByteArray &baData
+    )
+{
+    //Number of commands which have finished (with 00 or an 01 error) in the received bytes
+    quint8 intResponses = 0;
+    qint32 intPosition = baData.indexOf('\n');
+    while (intPosition != -1 && intPosition + 3 < baData.length())
+    {
+        if (baData.at(intPosition + 1) == '0' && baData.at(intPosition + 2) == '0' && baData.at(intPosition + 3) == '\r')
+        {
+            //Success
+            ++intResponses;
+        }
+        else if (baData.at(intPosition + 1) == '0' && baData.at(intPosition + 2) == '1' && baData.indexOf('\r', intPosition + 3) != -1)
+        {
+            //Error, once its line has ended
+            ++intResponses;
+        }
+        intPosition = baData.indexOf('\n', intPosition + 1);
+    }
+    return intResponses;
+}
+
+//=============================================================================
+//=============================================================================
+bool
+MainWindow::IsAddress(
+    const char *pData,
+    qint32 intLength
+    )
+{
+    //True if the data is a Bluetooth address (or license) as returned by at i 4 and at i 14
+    if (intLength != LicenseAddressLength)
+    {
+        return false;
+    }
+    qint32 i = 0;
+    while (i < intLength)
+    {
+        if (!((pData[i] >= '0' && pData[i] <= '9') || (pData[i] >= 'a' && pData[i] <= 'z') || (pData[i] >= 'A' && pData[i] <= 'Z')))
+        {
+            return false;
+        }
+        ++i;
+    }
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::IdentifyModule(
+    )
+{
+    //Checks the responses against the allow-lists, erasing only modules which match
+    gpIdentifyTimer->stop();
+    qint32 intFirmwareLength = 0;
+    qint32 intFirmware = ResponseValue(gbaTermBusyData, "\n10\t3\t", &intFirmwareLength);
+    qint32 intTypeLength = 0;
+    qint32 intType = ResponseValue(gbaTermBusyData, "\n10\t0\t", &intTypeLength);
+    QString strFirmware = (intFirmware != -1 ? QString::fromLatin1(gbaTermBusyData.constData() + intFirmware, intFirmwareLength).trimmed() : QString());
+    QString strType = (intType != -1 ? QString::fromLatin1(gbaTermBusyData.constData() + intType, intTypeLength).trimmed() : QString());
+    gbaTermBusyData.resize(0);
+    gchTermBusyLines = 0;
+
+    //A missing response only passes if that value is not being checked
+    bool bFirmwareAllowed = (gslAllowedFirmware.count() == 0 || (intFirmware != -1 && IdentityAllowed(gslAllowedFirmware, strFirmware) == true));
+    bool bTypeAllowed = (gslAllowedTypes.count() == 0 || (intType != -1 && IdentityAllowed(gslAllowedTypes, strType) == true));
+    if (DtmEvent::IsEnabled() == true)
+    {
+        DtmEvent("identity").Add("firmware", strFirmware).Add("device_type", strType).Add("allowed", (bFirmwareAllowed == true && bTypeAllowed == true)).Emit();
+    }
+    gbaDisplayBuffer.append(QString("[Firmware ").append(strFirmware.length() > 0 ? strFirmware : "unknown").append(", device type ").append(strType.length() > 0 ? strType : "unknown").append("]\n").toUtf8());
+
+    if (bFirmwareAllowed == true && bTypeAllowed == true)
+    {
+        //Expected module, carry on with the erase
+        StartEraseFS(gintIdentifyBaud, gintIdentifyFlow);
+        return;
+    }
+
+    //Wrong module or firmware, fail before the erase
+    QString strResultData = QString("Module rejected before erasing: ");
+    if (bFirmwareAllowed == false)
+    {
+        strResultData.append("firmware ").append(strFirmware.length() > 0 ? strFirmware : "unknown").append(" is not one of ").append(gslAllowedFirmware.join(", ")).append(". ");
+    }
+    if (bTypeAllowed == false)
+    {
+        strResultData.append("device type ").append(strType.length() > 0 ? strType : "unknown").append(" is not one of ").append(gslAllowedTypes.join(", ")).append(". ");
+    }
+    gpSystemTimeout->stop();
+    gbaDisplayBuffer.append(QString("\r\n").append(strResultData).append("\r\n").toUtf8());
+    ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
+    ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
+
+    //Close port
+    TermClose();
+    RecordResult(ExitCodeIdentityMismatch);
+
+    //Show result
+    if (gbExitOnFinish == true)
+    {
+        //Exit application
+        QApplication::exit(ExitCodeIdentityMismatch);
+    }
+    else if (gintPoolTrigger == PoolTriggerNone)
+    {
+        //Show result on message box
+        QMessageBox::warning(this, "Exit DTM mode result", strResultData, QMessageBox::Close);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::IdentifyTimeout(
+    )
+{
+    //Not every response arrived, decide on what was received
+    DtmTimelineScope dtsScope("IdentifyTimeout", "timer");
+    DtmLoopScope dlsScope(MetricsHandlerIdentifyTimeout);
+    if (gintProgramState != ProgramStatusIdentify)
+    {
+        return;
+    }
+    IdentifyModule();
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::AddBaudCandidate(
+    qint32 intBaud,
+    quint8 intFlow
+    )
+{
+    //Adds a setting to try, unless it is already in the list
+    int i = 0;
+    while (i < glstProbeBauds.count())
+    {
+        if (glstProbeBauds[i] == intBaud && glstProbeFlows[i] == intFlow)
+        {
+            return;
+        }
+        ++i;
+    }
+    glstProbeBauds.append(intBaud);
+    glstProbeFlows.append(intFlow);
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::StartBaudDetect(
+    )
+{
+    //Builds the list of settings to try, starting with the setting of the unit last seen on this port
+    //then those that have worked most often on this port
+    glstProbeBauds.clear();
+    glstProbeFlows.clear();
+
+    gpPersistentSettings->beginGroup(QString("AutoBaud/").append(ui->combo_COM->currentText()));
+    QString strUnit = gpPersistentSettings->value("Unit").toString();
+    QStringList lstHistory = gpPersistentSettings->value("Last").toString().split("_");
+    gpPersistentSettings->endGroup();
+    if (strUnit.length() > 0)
+    {
+        //Same unit is usually re-run on the fixture, so its own setting is the most likely
+        QStringList lstUnit = gpPersistentSettings->value(QString("Units/").append(strUnit).append("/Setting")).toString().split("_");
+        if (lstUnit.count() == 2)
+        {
+            AddBaudCandidate(lstUnit[0].toInt(), lstUnit[1].toUInt());
+        }
+    }
+
+    gpPersistentSettings->beginGroup(QString("AutoBaud/").append(ui->combo_COM->currentText()));
+    if (lstHistory.count() == 2)
+    {
+        //Last setting that worked
+        AddBaudCandidate(lstHistory[0].toInt(), lstHistory[1].toUInt());
+    }
+
+    QStringList lstKeys = gpPersistentSettings->childKeys();
+    lstKeys.removeAll("Last");
+    lstKeys.removeAll("Unit");
+    while (lstKeys.count() > 0)
+    {
+        //Add remaining settings, highest success count first
+        int intBest = 0;
+        int i = 1;
+        while (i < lstKeys.count())
+        {
+            if (gpPersistentSettings->value(lstKeys[i]).toUInt() > gpPersistentSettings->value(lstKeys[intBest]).toUInt())
+            {
+                intBest = i;
+            }
+            ++i;
+        }
+        lstHistory = lstKeys.takeAt(intBest).split("_");
+        if (lstHistory.count() == 2)
+        {
+            AddBaudCandidate(lstHistory[0].toInt(), lstHistory[1].toUInt());
+        }
+    }
+    gpPersistentSettings->endGroup();
+
+    //Then the selected setting, then the common rates
+    AddBaudCandidate(UserBaudRate(), UserFlowControl());
+    quint8 i = 0;
+    while (i < BaudProbeRateCount)
+    {
+        AddBaudCandidate(BaudProbeRates[i], UserFlowControl());
+        ++i;
+    }
+    if (UserFlowControl() != QSerialPort::NoFlowControl)
+    {
+        i = 0;
+        while (i < BaudProbeRateCount)
+        {
+            AddBaudCandidate(BaudProbeRates[i], QSerialPort::NoFlowControl);
+            ++i;
+        }
+    }
+
+    SetProgramState(ProgramStatusBaudDetect);
+    gintProbeIndex = -1;
+    ProbeNextBaud();
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::ProbeNextBaud(
+    )
+{
+    //Re-opens the port at the next candidate setting and checks if the module responds
+    DtmTimelineScope dtsScope("ProbeNextBaud", "timer", gintProbeIndex);
+    DtmLoopScope dlsScope(MetricsHandlerProbeNextBaud);
+    if (gintProgramState != ProgramStatusBaudDetect)
+    {
+        return;
+    }
+
+    ++gintProbeIndex;
+    while (gintProbeIndex < glstProbeBauds.count())
+    {
+        gbaTermBusyData.resize(0);
+        gchTermBusyLines = 0;
+        OpenDevice((QSerialPort::BaudRate)glstProbeBauds[gintProbeIndex], (QSerialPort::FlowControl)glstProbeFlows[gintProbeIndex]);
+        if (SerialIsOpen() == true)
+        {
+            //Send an empty line to clear any garbage, then a command which should respond with 00
+            DoLineEnd();
+            SerialQueue("at");
+            DoLineEnd();
+            SerialFlush();
+            gbaDisplayBuffer.append(QString("< at [").append(QString::number(glstProbeBauds[gintProbeIndex])).append("]\n"));
+            ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
+            ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
+            gpBaudProbeTimer->start();
+            return;
+        }
+        ++gintProbeIndex;
+    }
+
+    //No setting worked, carry on with the selected setting
+    gbaDisplayBuffer.append("[Baud rate detection failed, using selected settings]\n");
+    StartIdentify(UserBaudRate(), UserFlowControl());
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::BaudDetected(
+    )
+{
+    //Module responded, remember the setting for this fixture and carry on at it
+    gpBaudProbeTimer->stop();
+    qint32 intBaud = glstProbeBauds[gintProbeIndex];
+    quint8 intFlow = glstProbeFlows[gintProbeIndex];
+    gstrDetectedSetting = QString::number(intBaud).append("_").append(QString::number(intFlow));
+
+    gpPersistentSettings->beginGroup(QString("AutoBaud/").append(ui->combo_COM->currentText()));
+    gpPersistentSettings->setValue(gstrDetectedSetting, gpPersistentSettings->value(gstrDetectedSetting, 0).toUInt() + 1);
+    gpPersistentSettings->setValue("Last", gstrDetectedSetting);
+    gpPersistentSettings->endGroup();
+
+    gbaDisplayBuffer.append(QString("[Detected ").append(QString::number(intBaud)).append(" baud, flow control ").append((intFlow == QSerialPort::NoFlowControl ? "N" : intFlow == QSerialPort::HardwareControl ? "H" : "S")).append("]\n"));
+    gbaTermBusyData.resize(0);
+    gchTermBusyLines = 0;
+    StartIdentify((QSerialPort::BaudRate)intBaud, (QSerialPort::FlowControl)intFlow);
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::StartLicenseCheck(
+    )
+{
+    //Check the license and BT address
+    SetProgramState(ProgramStatusLicenseCheck);
+    SerialQueue("at i 4");
+    DoLineEnd();
+    gbaDisplayBuffer.append("< at i 4\n");
+    SerialQueue("at i 14");
+    DoLineEnd();
+    SerialFlush();
+    gbaDisplayBuffer.append("< at i 14\n");
+    ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
+    ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::StartLicenseInstall(
+    const QByteArray &baLicense
+    )
+{
+    //Writes a license from the key file to the module, only attempted once per session
+    SetProgramState(ProgramStatusLicenseInstall);
+    gbLicenseInstalled = true;
+    SerialQueue(QByteArray(LicenseInstallCommand).append(baLicense));
+    DoLineEnd();
+    SerialFlush();
+    gbaDisplayBuffer.append(QString("< ").append(LicenseInstallCommand).append(baLicense).append("\n").toUtf8());
+    ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
+    ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::ContinueAfterEscape(
+    )
+{
+    //Module is out of DTM, run the optional switch-over then the optional license check
+    if (gintHighSpeedBaud > 0 && gbHighSpeedDone == false && gbReplayActive == false)
+    {
+        StartHighSpeed();
+    }
+    else if (ui->check_License->isChecked())
+    {
+        StartLicenseCheck();
+    }
+    else
+    {
+        FinishWithoutLicenseCheck();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::StartHighSpeed(
+    )
+{
+    //Times a query at the current rate before moving the module and host to the high rate
+    gbHighSpeedDone = true;
+    gintHighSpeedOrigBaud = gspSerialPort.baudRate();
+    gintHighSpeedOrigFlow = gspSerialPort.flowControl();
+    gintHighSpeedBefore = 0;
+    gintHighSpeedStep = HighSpeedStepMeasure;
+    SetProgramState(ProgramStatusHighSpeed);
+    HighSpeedSendQuery();
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::HighSpeedSendQuery(
+    )
+{
+    //Sends a burst of queries in one write and times all of the responses to measure the throughput
+    gbaTermBusyData.resize(0);
+    gchTermBusyLines = 0;
+    gintHighSpeedExpected = HighSpeedQueryCount;
+    gtmrHighSpeed.start();
+    quint8 i = 0;
+    while (i < HighSpeedQueryCount)
+    {
+        SerialQueue(HighSpeedQuery);
+        DoLineEnd();
+        ++i;
+    }
+    SerialFlush();
+    gbaDisplayBuffer.append("< ").append(HighSpeedQuery).append(" (x").append(QByteArray::number(HighSpeedQueryCount)).append(")\n");
+    ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
+    ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
+    gpHighSpeedTimer->start();
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::HighSpeedResponse(
+    bool bAccepted
+    )
+{
+    //Moves the switch-over on when the module responds
+    if (gintHighSpeedStep == HighSpeedStepDrain)
+    {
+        //Reply to the revert at the high rate, the host is about to move back so it is not needed
+        return;
+    }
+    gpHighSpeedTimer->stop();
+    quint64 intThroughput = (quint64)(sizeof(HighSpeedQuery)*HighSpeedQueryCount + gbaTermBusyData.length())*1000000000ULL/qMax(gtmrHighSpeed.nsecsElapsed(), (qint64)1);
+    gbaTermBusyData.resize(0);
+    gchTermBusyLines = 0;
+
+    if (gintHighSpeedStep == HighSpeedStepRevert)
+    {
+        //Module is back at the original rate
+        ContinueAfterEscape();
+    }
+    else if (bAccepted == false)
+    {
+        //Query or rate change rejected
+        HighSpeedFallback();
+    }
+    else if (gintHighSpeedStep == HighSpeedStepMeasure)
+    {
+        //Check the serial device can use the rate before the module is asked to change, as it could not be moved back otherwise
+        gintHighSpeedBefore = intThroughput;
+        if (gspSerialPort.setBaudRate(gintHighSpeedBaud) == false)
+        {
+            gspSerialPort.setBaudRate(gintHighSpeedOrigBaud);
+            HighSpeedFallback();
+            return;
+        }
+        gspSerialPort.setBaudRate(gintHighSpeedOrigBaud);
+
+        //Ask the module to change rate, its response is at the original rate
+        gintHighSpeedStep = HighSpeedStepSwitch;
+        gintHighSpeedExpected = 1;
+        QByteArray baCommand = QString(gstrHighSpeedCommand).replace("%1", QString::number(gintHighSpeedBaud)).toUtf8();
+        SerialQueue(baCommand);
+        DoLineEnd();
+        SerialFlush();
+        gbaDisplayBuffer.append("< ").append(baCommand).append("\n");
+        gpHighSpeedTimer->start();
+    }
+    else if (gintHighSpeedStep == HighSpeedStepSwitch)
+    {
+        //Module has accepted the rate, follow it on the open port and check the link
+        gintHighSpeedStep = HighSpeedStepVerify;
+        if (gspSerialPort.setBaudRate(gintHighSpeedBaud) == false)
+        {
+            //Worked when checked, the port is still open so the module can be moved back
+            HighSpeedFallback();
+            return;
+        }
+        gtwTraceWriter.RecordOpen((QSerialPort::BaudRate)gintHighSpeedBaud, gintHighSpeedOrigFlow);
+        gspSerialPort.clear();
+        grbRXBuffer.Clear();
+        HighSpeedSendQuery();
+    }
+    else
+    {
+        //Link works at the high rate
+        gbaDisplayBuffer.append(QString("[UART ").append(QString::number(gintHighSpeedOrigBaud)).append(" -> ").append(QString::number(gintHighSpeedBaud)).append(" baud, throughput ").append(QString::number(gintHighSpeedBefore)).append(" -> ").append(QString::number(intThroughput)).append(" bytes/s]\n").toUtf8());
+        ContinueAfterEscape();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::HighSpeedTimeout(
+    )
+{
+    //Module did not respond whilst switching
+    DtmTimelineScope dtsScope("HighSpeedTimeout", "timer");
+    DtmLoopScope dlsScope(MetricsHandlerHighSpeedTimeout);
+    if (gintProgramState != ProgramStatusHighSpeed)
+    {
+        return;
+    }
+    if (gintHighSpeedStep == HighSpeedStepDrain)
+    {
+        //Revert command has not been reported as sent, move the host back anyway
+        HighSpeedRevertHost();
+    }
+    else if (gintHighSpeedStep == HighSpeedStepRevert)
+    {
+        //Carry on regardless, any late response is discarded
+        gbaTermBusyData.resize(0);
+        gchTermBusyLines = 0;
+        ContinueAfterEscape();
+    }
+    else
+    {
+        HighSpeedFallback();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::HighSpeedFallback(
+    )
+{
+    //Puts the module (which may have changed rate) and the host back to the original rate
+    gbaDisplayBuffer.append(QString("[High speed switch-over failed, staying at ").append(QString::number(gintHighSpeedOrigBaud)).append(" baud]\n").toUtf8());
+    if (gintHighSpeedStep == HighSpeedStepMeasure)
+    {
+        //Nothing has been changed yet
+        ContinueAfterEscape();
+        return;
+    }
+
+    if (SerialIsOpen() == true)
+    {
+        //Ask the module to go back, sent at whatever rate the host is using. The host follows once the
+        //command has been written (SerialBytesWritten) or the step times out, without blocking the event loop
+        gintHighSpeedStep = HighSpeedStepDrain;
+        SerialQueue(QString(gstrHighSpeedCommand).replace("%1", QString::number(gintHighSpeedOrigBaud)).toUtf8());
+        DoLineEnd();
+        SerialFlush();
+        if (gintHighSpeedStep == HighSpeedStepDrain && gintTXPending > 0)
+        {
+            gpHighSpeedTimer->start();
+            return;
+        }
+    }
+    HighSpeedRevertHost();
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::HighSpeedRevertHost(
+    )
+{
+    //Puts the host back to the original rate and waits for the module to respond there
+    if (gintHighSpeedStep == HighSpeedStepRevert)
+    {
+        //Already moved back
+        return;
+    }
+    gpHighSpeedTimer->stop();
+    gintHighSpeedStep = HighSpeedStepRevert;
+    gintHighSpeedExpected = 1;
+    if (SerialIsOpen() == true && gspSerialPort.baudRate() != gintHighSpeedOrigBaud && gspSerialPort.setBaudRate(gintHighSpeedOrigBaud) == true)
+    {
+        //Back at the original rate on the open port
+        gtwTraceWriter.RecordOpen((QSerialPort::BaudRate)gintHighSpeedOrigBaud, gintHighSpeedOrigFlow);
+    }
+    else if (SerialIsOpen() == false || gspSerialPort.baudRate() != gintHighSpeedOrigBaud)
+    {
+        OpenDevice((QSerialPort::BaudRate)gintHighSpeedOrigBaud, gintHighSpeedOrigFlow);
+    }
+    if (SerialIsOpen() == false)
+    {
+        //Original setting worked before, this should not happen
+        SystemTimeout();
+        return;
+    }
+
+    //Wait for any response to the revert before carrying on
+    gbaTermBusyData.resize(0);
+    gchTermBusyLines = 0;
+    gpHighSpeedTimer->start();
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::FinishWithoutLicenseCheck(
+    )
+{
+    //Module is out of DTM and no license check was requested, finished
+    ui->text_TermEditData->appendPlainText("License check not performed.");
+
+    //Clean up
+    gbaTermBusyData.resize(0);
+    gchTermBusyLines = 0;
+    SetProgramState(ProgramStatusIdle);
+    if (gbEscapeSkipped == false)
+    {
+        gdmMetrics.EscapeCompleted(gtmrEscape.nsecsElapsed());
+    }
+    gpSystemTimeout->stop();
+    gbaDisplayBuffer.append(gbEscapeSkipped == true ? "\r\n\r\n ~ Module was not in DTM mode, no escape needed ~ \r\n" : "\r\n\r\n ~ DTM escape complete ~ \r\n");
+    ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
+    ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
+
+    //Close port
+    TermClose();
+    RecordResult(ExitCodeOK);
+
+    //Show result
+    if (gbExitOnFinish == true)
+    {
+        //Module is out of DTM
+        QApplication::exit(ExitCodeOK);
+    }
+    else if (gintPoolTrigger == PoolTriggerNone)
+    {
+        //Show result on message box
+        QMessageBox::information(this, "Exit DTM mode result", QString(gbEscapeSkipped == true ? "Module was not in DTM mode, no escape or erase was needed." : "Escape from DTM mode complete, you can now communicate with the module as required.").append("\r\n\r\nYour module's license has been unchecked, and is ready for use.\r\n"), QMessageBox::Close);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::StartSession(
+    )
+{
+    //Starts processing the selected module
+    if (DtmEvent::IsEnabled() == true)
+    {
+        DtmEvent("start").Emit();
+    }
+    gbLicenseInstalled = false;
+    gsbStatusBlock.SetLicense(StatusLicenseUnknown);
+    gbHighSpeedDone = false;
+    gbPoolArmed = false;
+    if (gbHealth == true && gbReplayActive == false && ui->combo_COM->currentText().length() > 0 && (gphPortHealth.IsSetup() == false || gphPortHealth.Port() != ui->combo_COM->currentText()))
+    {
+        //The port can be changed in the window after startup, track (and quarantine) the one actually used
+        gphPortHealth.Setup(gpPersistentSettings, ui->combo_COM->currentText(), gdblHealthDrift, gbQuarantine);
+    }
+    if (gbQuarantine == true && gphPortHealth.IsQuarantined() == true)
+    {
+        //Port has been taken out of service
+        RecordResult(ExitCodeQuarantined);
+        if (gbExitOnFinish == true)
+        {
+            //Exit with error code
+            gintExitCode = ExitCodeQuarantined;
+            gpExitTimer->start();
+        }
+        else if (gintPoolTrigger == PoolTriggerNone)
+        {
+            //Show error
+            QMessageBox::warning(this, "Port quarantined", QString("This port has been quarantined (").append(gphPortHealth.Reason()).append("). Check the fixture and run with HEALTHRESET once repaired."), QMessageBox::Ok);
+        }
+        return;
+    }
+    ApplyAdapterProfile();
+    if (gbHubSchedule == true && gbReplayActive == false)
+    {
+        //Wait for the hub to have capacity
+        gpHubWaitTimer->stop();
+        ghsHubScheduler.Setup(gpPersistentSettings, ui->combo_COM->currentText());
+        if (ghsHubScheduler.TryAcquire() == false)
+        {
+            ui->statusBar->showMessage(QString("Waiting for a slot on USB hub ").append(ghsHubScheduler.Hub()).append("..."));
+            gpHubWaitTimer->start();
+            return;
+        }
+        gpHubStaggerTimer->start();
+    }
+    BeginSession();
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::BeginSession(
+    )
+{
+    //Opens the port once any hub slot is held
+    if (gbVerifyFirst == true)
+    {
+        //Find out if an escape is needed first
+        StartVerify();
+    }
+    else
+    {
+        //Escape straight away
+        OpenDevice(DTMBaudRate, DTMFlowControl);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::StartVerify(
+    )
+{
+    //Opens the port at the interactive settings to check if the module is in DTM without erasing it
+    gbaTermBusyData.resize(0);
+    gchTermBusyLines = 0;
+    SetProgramState(ProgramStatusProbe);
+    OpenDevice(UserBaudRate(), UserFlowControl());
+    if (SerialIsOpen() == false)
+    {
+        //Port could not be opened, error has already been reported
+        SetProgramState(ProgramStatusIdle);
+        return;
+    }
+    gpSystemTimeout->start(ModuleTimeout);
+
+#ifndef TARGET_OS_MAC
+    if (gbCTSStatus == 0)
+    {
+        //CTS is deasserted whilst in DTM, so an escape is needed
+        SetProgramState(ProgramStatusIdle);
+        gpSystemTimeout->stop();
+        OpenDevice(DTMBaudRate, DTMFlowControl);
+        return;
+    }
+#endif
+
+    //Send a harmless command which only gets a 00 response in interactive mode
+    DoLineEnd();
+    SerialQueue("at");
+    DoLineEnd();
+    SerialFlush();
+    gbaDisplayBuffer.append("< at\n");
+    ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
+    ui->text_TermEditData->verticalScrollBar()->setValue(ui->text_TermEditData->verticalScrollBar()->maximum());
+    gpVerifyTimer->start();
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::VerifyTimeout(
+    )
+{
+    //Module did not respond in interactive mode, escape from DTM as normal
+    DtmTimelineScope dtsScope("VerifyTimeout", "timer");
+    DtmLoopScope dlsScope(MetricsHandlerVerifyTimeout);
+    if (gintProgramState == ProgramStatusProbe)
+    {
+        gbaTermBusyData.resize(0);
+        gchTermBusyLines = 0;
+        SetProgramState(ProgramStatusIdle);
+        gpSystemTimeout->stop();
+        OpenDevice(DTMBaudRate, DTMFlowControl);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::ModuleNotInDTM(
+    )
+{
+    //Module responded in interactive mode, only the queries are needed
+    gpVerifyTimer->stop();
+    gbEscapeSkipped = true;
+    gbaTermBusyData.resize(0);
+    gchTermBusyLines = 0;
+    gbaDisplayBuffer.append("[Module is not in DTM mode]\n");
+    ContinueAfterEscape();
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::StartCoroutineSession(
+    )
+{
+    //Runs the escape as a coroutine on its own session, without the state machine
+    gpSession = new DtmSession(ui->combo_COM->currentText(), this);
+    gtskSession = gpSession->Escape(UserBaudRate(), UserFlowControl(), gintRetryMaxAttempts, ui->check_License->isChecked(), gslAllowedFirmware, gslAllowedTypes);
+    gdmMetrics.EscapeStarted();
+    gtmrEscape.start();
+    ui->btn_Connect->setEnabled(false);
+    ui->statusBar->showMessage(QString("[").append(ui->combo_COM->currentText()).append("] Escaping from DTM mode..."));
+    gtskSession.Start([this](int intExitCode) { CoroutineSessionFinished(intExitCode); });
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::CoroutineSessionFinished(
+    int intExitCode
+    )
+{
+    //Escape coroutine has returned, the session is deleted once control returns to the event loop
+    if (intExitCode == ExitCodeOK || intExitCode == ExitCodeLicenseMissing)
+    {
+        gdmMetrics.EscapeCompleted(gtmrEscape.nsecsElapsed());
+    }
+    RecordResult(intExitCode);
+    gpSession->deleteLater();
+    gpSession = NULL;
+    ui->btn_Connect->setEnabled(true);
+    ui->statusBar->showMessage(QString("Escape finished with exit code ").append(QString::number(intExitCode)));
+
+    if (gbExitOnFinish == true)
+    {
+        //Exit with the result
+        gintExitCode = intExitCode;
+        gpExitTimer->start();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::PoolCheckUnit(
+    quint32 intSignals
+    )
+{
+    //Starts on the next module once the previous one has been removed (whatever its result) and DSR has settled
+    if ((intSignals & QSerialPort::DataSetReadySignal) != QSerialPort::DataSetReadySignal)
+    {
+        //Previous module has gone
+        gbPoolArmed = true;
+        gtmrPoolSettle.invalidate();
+    }
+    else if (gbPoolArmed == true)
+    {
+        if (gtmrPoolSettle.isValid() == false)
+        {
+            //Module inserted, wait for the line to settle
+            gtmrPoolSettle.start();
+        }
+        else if (gtmrPoolSettle.elapsed() >= PoolSettleTime)
+        {
+            //Start on the new module
+            gtmrPoolSettle.invalidate();
+            DtmTimeline::Record("PoolModuleDetected", "signals", TimelinePhaseInstant);
+            StartSession();
+        }
+    }
+}
+
+//=============================================================================
+//=============================================================================
+quint64
+MainWindow::PeakMemoryUsage(
+    )
+{
+    //Returns the peak resident set size of the process (in KiB)
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmcCounters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmcCounters, sizeof(pmcCounters)))
+    {
+        return pmcCounters.PeakWorkingSetSize/1024;
+    }
+    return 0;
+#else
+    struct rusage ruUsage;
+    if (getrusage(RUSAGE_SELF, &ruUsage) != 0)
+    {
+        return 0;
+    }
+#ifdef __APPLE__
+    //Reported in bytes on mac
+    return ruUsage.ru_maxrss/1024;
+#else
+    return ruUsage.ru_maxrss;
+#endif
+#endif
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::WriteStartupBench(
+    )
+{
+    //Appends this run to the startup benchmark file (one line per run, grouped by version)
+    if (gstrStartupBenchFile.length() == 0)
+    {
+        return;
+    }
+
+    QFile fileBench(gstrStartupBenchFile);
+    bool bNew = (fileBench.exists() == false || fileBench.size() == 0);
+    if (fileBench.open(QIODevice::WriteOnly | QIODevice::Append) == false)
+    {
+        return;
+    }
+    if (bNew == true)
+    {
+        fileBench.write("version,window,constructed_ms,first_tx_ms,peak_rss_kib\n");
+    }
+    fileBench.write(QString("%1,%2,%3,%4,%5\n").arg(AppVersion).arg(isVisible() == true ? "shown" : "hidden").arg(gintStartupConstructed/1000000.0, 0, 'f', 2).arg(gintStartupFirstTX < 0 ? QString("") : QString::number(gintStartupFirstTX/1000000.0, 'f', 2)).arg(PeakMemoryUsage()).toUtf8());
+    fileBench.close();
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::HubWaitFinished(
+    )
+{
+    //Tries again to get a slot on the hub, or to hand back the slot of the last module
+    DtmTimelineScope dtsScope("HubWaitFinished", "timer");
+    DtmLoopScope dlsScope(MetricsHandlerHubWait);
+    if (ghsHubScheduler.IsReleasing() == true)
+    {
+        if (ghsHubScheduler.RetryRelease() == true)
+        {
+            gpHubWaitTimer->stop();
+        }
+    }
+    else if (ghsHubScheduler.TryAcquire() == true)
+    {
+        gpHubWaitTimer->stop();
+        gpHubStaggerTimer->start();
+        BeginSession();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::HubStaggerFinished(
+    )
+{
+    //Port has had time to settle, let the next instance on the hub open its port
+    ghsHubScheduler.OpeningFinished();
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::ApplyAdapterProfile(
+    )
+{
+    //Sets the response timeouts and modem line poll interval from the profile of the selected adapter
+    DtmAdapterProfile dapProfile;
+    if (DtmAdapterProfiler::Load(gpPersistentSettings, DtmAdapterProfiler::AdapterKey(ui->combo_COM->currentText()), &dapProfile) == true)
+    {
+        gintSignalPollInterval = DtmAdapterProfiler::PollInterval(dapProfile);
+        gpBaudProbeTimer->setInterval(DtmAdapterProfiler::ResponseTimeout(dapProfile, BaudProbeTimeout));
+        gpVerifyTimer->setInterval(DtmAdapterProfiler::ResponseTimeout(dapProfile, VerifyProbeTimeout));
+        gbaDisplayBuffer.append(QString("[Adapter profile: poll ").append(QString::number(gintSignalPollInterval)).append(" ms, response timeout ").append(QString::number(gpBaudProbeTimer->interval())).append(" ms]\n").toUtf8());
+    }
+    else
+    {
+        //Not characterised, use the defaults
+        gintSignalPollInterval = ProfileMaxPollInterval;
+        gpBaudProbeTimer->setInterval(BaudProbeTimeout);
+        gpVerifyTimer->setInterval(VerifyProbeTimeout);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::CharacteriseAdapter(
+    )
+{
+    //Measures the selected adapter through a loopback plug and stores its profile
+    DtmAdapterProfiler dapProfiler;
+    DtmAdapterProfile dapProfile;
+    QString strError;
+    QString strResult = QString("[").append(ui->combo_COM->currentText()).append("] ");
+    gintExitCode = ExitCodeOK;
+    if (dapProfiler.Characterise(ui->combo_COM->currentText(), UserBaudRate(), &dapProfile, &strError) == true)
+    {
+        DtmAdapterProfiler::Save(gpPersistentSettings, dapProfile);
+        strResult.append(dapProfile.strKey).append(": ").append(DtmAdapterProfiler::Describe(dapProfile));
+        strResult.append(QString(", response timeout %1 ms, poll %2 ms").arg(DtmAdapterProfiler::ResponseTimeout(dapProfile, BaudProbeTimeout)).arg(DtmAdapterProfiler::PollInterval(dapProfile)));
+    }
+    else
+    {
+        strResult.append("Error: ").append(strError);
+        gintExitCode = ExitCodeSerialPortError;
+    }
+
+    gbaDisplayBuffer.append(strResult.append("\n").toUtf8());
+    ui->text_TermEditData->setPlainText(gbaDisplayBuffer);
+    ui->selector_Tab->setCurrentIndex(ui->selector_Tab->indexOf(ui->tab_Disp));
+    QTextStream(stdout) << strResult;
+
+    if (gbExitOnFinish == true)
+    {
+        //Exit with the result
+        gpExitTimer->start();
+    }
+}
+
+#ifdef TARGET_OS_MAC
+//=============================================================================
+//=============================================================================
+void
+MainWindow::ContinueOperationMacDoesntSupportCTSWorkaroundFunction(
+    )
+{
+    //Workaround for mac
+    if (gintProgramState == ProgramStatusExitDTM)
+    {
+        //We will just assume that the module has reset in normal mode
+        ModuleExitedDTM();
+    }
+}
+#endif
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::on_btn_Cancel_clicked(
+    )
+{
+    //Cancel operation
+    TermClose();
+    gpHubWaitTimer->stop();
+    gpHubStaggerTimer->stop();
+    ghsHubScheduler.Unlock();
+    ui->statusBar->showMessage("Operation cancelled!");
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::on_btn_Help_clicked(
+    )
+{
+    //Open help file
+    if (QDesktopServices::openUrl(QUrl(QString("http://").append(ServerHost).append("/exitdtm_help.pdf"))) == false)
+    {
+        //Failed to open
+        QMessageBox::critical(this, "Error opening help file", QString("An error occured whilst attempting to open the online help file: http://").append(ServerHost).append("/exitdtm_help.pdf"), QMessageBox::Ok, QMessageBox::NoButton);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+MainWindow::LoopStalled(
+    qint64 intLag,
+    const QString &strHandler
+    )
+{
+    //The event loop was held up, note it in the output so a slow escape can be put down to the host
+    QString strWarning = QString("Event loop stalled for ").append(QString::number(intLag)).append("ms (").append(strHandler).append(")");
+    qWarning() << strWarning;
+    gbaDisplayBuffer.append("\r\n[").append(strWarning.toUtf8()).append("]\r\n");
+    if (gintPoolTrigger == PoolTriggerNone && isVisible() == true)
+    {
+        ui->statusBar->showMessage(strWarning);
     }
 }
 
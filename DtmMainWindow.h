@@ -35,6 +35,24 @@
 #include <QScrollBar>
 #include <QDebug>
 #include <QDesktopServices>
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QTextStream>
+#include "DtmConstants.h"
+#include "DtmTrace.h"
+#include "DtmMetrics.h"
+#include "DtmAdapterProfile.h"
+#include "DtmHubScheduler.h"
+#include "DtmSession.h"
+#include "DtmLicenseStore.h"
+#include "DtmTimeline.h"
+#include "DtmRingBuffer.h"
+#include "DtmClock.h"
+#include "DtmResultTable.h"
+#include "DtmLoopMonitor.h"
+#include "DtmStatusBlock.h"
+#include "DtmPortHealth.h"
+#include "DtmEvents.h"
 
 /******************************************************************************/
 // Constants
@@ -42,29 +60,42 @@
 //Constants for version and functions
 const QString                  AppVersion                 = "1.0"; //Version string
 
-//Constants for timeouts and streaming
-const qint16                   ModuleTimeout              = 14000; //Time (in ms) until a part of the process is considered timed out
-
-//Constants for program state
-const quint8                   ProgramStatusIdle          = 0;
-const quint8                   ProgramStatusExitDTM       = 1;
-const quint8                   ProgramStatusEraseFS       = 2;
-const quint8                   ProgramStatusLicenseCheck  = 3;
-const quint8                   ProgramStatus              = 4;
-
-//Command codes used to exit DTM mode and DTM options
-const quint8                   DTMExitCMDA                = 0x3f;
-const quint8                   DTMExitCMDB                = 0xff;
-const QSerialPort::BaudRate    DTMBaudRate                = QSerialPort::Baud19200;
-const QSerialPort::FlowControl DTMFlowControl             = QSerialPort::NoFlowControl;
-
-//Exit code results
-const int                      ExitCodeOK                 = 0;
-const int                      ExitCodeInvalidPort        = -1;
-const int                      ExitCodeCTSAsserted        = -2;
-const int                      ExitCodeLicenseMissing     = -3;
-const int                      ExitCodeTimeout            = -4;
-const int                      ExitCodeSerialPortError    = -5;
+//Constants for the modem line used to reset the module between resends
+const quint8                   ResetLineNone              = 0;
+const quint8                   ResetLineDTR               = 1;
+const quint8                   ResetLineRTS               = 2;
+
+//Constants for baud rate and flow control detection
+const quint16                  BaudProbeTimeout           = 200; //Time (in ms) to wait for a response at each candidate setting
+const quint8                   BaudProbeRateCount         = 9;
+const qint32                   BaudProbeRates[BaudProbeRateCount] = {115200, 9600, 57600, 38400, 19200, 230400, 460800, 921600, 1000000}; //Rates tried after the fixture history, most common first
+
+//Constants for verify mode
+const quint16                  VerifyProbeTimeout         = 250; //Time (in ms) to wait for a module in interactive mode to respond
+
+//Constants for the high speed UART switch-over
+const quint16                  HighSpeedProbeTimeout      = 1000; //Time (in ms) to wait for each step's responses whilst switching
+const char                     HighSpeedQuery[]           = "at i 3"; //Query timed at each rate to measure throughput
+const quint8                   HighSpeedQueryCount        = 16; //Queries sent back to back when timing, so the transfer time outweighs the round trip latency
+const quint8                   HighSpeedStepMeasure       = 0; //Timing the query at the original rate
+const quint8                   HighSpeedStepSwitch        = 1; //Waiting for the module to accept the new rate
+const quint8                   HighSpeedStepVerify        = 2; //Timing the query at the new rate
+const quint8                   HighSpeedStepRevert        = 3; //Waiting for the module to go back to the original rate
+const quint8                   HighSpeedStepDrain         = 4; //Sending the revert command before the host goes back to the original rate
+
+//Constants for pooled ports (port kept open whilst modules are swapped)
+const quint8                   PoolTriggerNone            = 0;
+const quint8                   PoolTriggerDSR             = 1; //New module when DSR is asserted (CTS cannot be used, it is deasserted both in DTM and with no module fitted)
+const quint16                  PoolSettleTime             = 100; //Time (in ms) the trigger line must be stable before starting
+
+//Constants for the receive path
+const qint32                   DisplayBufferReserve       = 65536; //Bytes reserved for the display buffer at startup, the oldest lines are dropped to stay within it
+const qint32                   TermBusyDataLimit          = 4096; //Bytes of response data kept whilst waiting (responses are far shorter)
+const quint16                  DisplayRefreshInterval     = 50; //Time (in ms) received data is collected for before the terminal is redrawn
+const quint16                  TXQueueReserve             = 512; //Bytes reserved for the TX queue at startup
+
+//Time since the process started, used to measure startup
+extern QElapsedTimer gtmrProcessStart;
 
 //Server URL
 const QString ServerHost = "uwterminalx.lairdtech.com";            //Hostname/IP of online server with help file
@@ -84,6 +115,10 @@ class MainWindow : public QMainWindow
 {
     Q_OBJECT
 
+    friend class TestRXAllocation;
+    friend class TestVirtualTime;
+    friend class TestScriptedModule;
+
 public:
     explicit MainWindow(
         QWidget *parent = 0
@@ -93,6 +128,28 @@ public:
     void
     WindowSetup(
         );
+    static bool
+    IdentityAllowed(
+        const QStringList &slAllowed,
+        const QString &strValue
+        );
+
+signals:
+    void
+    ReplayWrite(
+        const QByteArray &baData
+        );
+    void
+    EscapeFinished(
+        int intExitCode
+        );
+
+protected:
+    bool
+    eventFilter(
+        QObject *pObject,
+        QEvent *pEvent
+        );
 
 public slots:
     void
@@ -133,6 +190,44 @@ private slots:
     void
     ForceClose(
         );
+    void
+    RetryExitDTM(
+        );
+    void
+    ResetPulseFinished(
+        );
+    void
+    ReplayStep(
+        );
+    void
+    WriteMetrics(
+        );
+    void
+    ProbeNextBaud(
+        );
+    void
+    VerifyTimeout(
+        );
+    void
+    HubWaitFinished(
+        );
+    void
+    HubStaggerFinished(
+        );
+    void
+    HighSpeedTimeout(
+        );
+    void
+    IdentifyTimeout(
+        );
+    void
+    RefreshDisplay(
+        );
+    void
+    LoopStalled(
+        qint64 intLag,
+        const QString &strHandler
+        );
 #ifdef TARGET_OS_MAC
     void
     ContinueOperationMacDoesntSupportCTSWorkaroundFunction(
@@ -151,6 +246,14 @@ private:
     RefreshSerialDevices(
         );
     void
+    TrimDisplayBuffer(
+        qint32 intIncoming
+        );
+    void
+    ReadDevice(
+        QIODevice *pDevice
+        );
+    void
     DoLineEnd(
         );
     void
@@ -168,25 +271,262 @@ private:
     void
     TermClose(
         );
+    void
+    SendExitDTM(
+        );
+    void
+    SetResetLine(
+        bool bAsserted
+        );
+    void
+    SerialWrite(
+        const QByteArray &baData
+        );
+    void
+    SerialQueue(
+        const QByteArray &baData
+        );
+    void
+    SerialFlush(
+        );
+    bool
+    SerialIsOpen(
+        );
+    quint32
+    SerialSignals(
+        );
+    void
+    ProcessSerialData(
+        const char *pData,
+        qint32 intLength
+        );
+    void
+    StartReplay(
+        const QString &strFilename
+        );
+    void
+    FinishReplay(
+        );
+    void
+    SetProgramState(
+        quint8 intState
+        );
+    void
+    RecordResult(
+        int intExitCode
+        );
+    QSerialPort::BaudRate
+    UserBaudRate(
+        );
+    QSerialPort::FlowControl
+    UserFlowControl(
+        );
+    void
+    ModuleExitedDTM(
+        );
+    void
+    StartEraseFS(
+        QSerialPort::BaudRate spbBaud,
+        QSerialPort::FlowControl spfFlow
+        );
+    void
+    StartIdentify(
+        QSerialPort::BaudRate spbBaud,
+        QSerialPort::FlowControl spfFlow
+        );
+    void
+    IdentifyModule(
+        );
+    static qint32
+    ResponseValue(
+        const QByteArray &baData,
+        const char *strPrefix,
+        qint32 *pintLength
+        );
+    static quint8
+    ResponseCount(
+        const QByteArray &baData
+        );
+    static bool
+    IsAddress(
+        const char *pData,
+        qint32 intLength
+        );
+    void
+    StartBaudDetect(
+        );
+    void
+    AddBaudCandidate(
+        qint32 intBaud,
+        quint8 intFlow
+        );
+    void
+    BaudDetected(
+        );
+    void
+    StartLicenseCheck(
+        );
+    void
+    FinishWithoutLicenseCheck(
+        );
+    void
+    StartLicenseInstall(
+        const QByteArray &baLicense
+        );
+    void
+    ContinueAfterEscape(
+        );
+    void
+    StartHighSpeed(
+        );
+    void
+    HighSpeedSendQuery(
+        );
+    void
+    HighSpeedResponse(
+        bool bAccepted
+        );
+    void
+    HighSpeedFallback(
+        );
+    void
+    HighSpeedRevertHost(
+        );
+    void
+    TimelineStage(
+        quint8 intFrom,
+        quint8 intTo
+        );
+    void
+    StartSession(
+        );
+    void
+    BeginSession(
+        );
+    void
+    StartVerify(
+        );
+    void
+    ModuleNotInDTM(
+        );
+    void
+    ApplyAdapterProfile(
+        );
+    void
+    CharacteriseAdapter(
+        );
+    quint64
+    PeakMemoryUsage(
+        );
+    void
+    WriteStartupBench(
+        );
+    void
+    StartCoroutineSession(
+        );
+    void
+    CoroutineSessionFinished(
+        int intExitCode
+        );
+    void
+    PoolCheckUnit(
+        quint32 intSignals
+        );
 
     //Private variables
     QSerialPort gspSerialPort; //Contains the handle for the serial port
-    quint16 gintRXBytes; //Number of RX bytes
-    quint16 gintTXBytes; //Number of TX bytes
+    quint64 gintRXBytes; //Number of RX bytes
+    quint64 gintTXBytes; //Number of TX bytes
+    QByteArray gbaTXQueue; //Data waiting to be sent in a single write at the next flush
+    qint64 gintTXPending; //Bytes handed to the port which have not been written yet
     unsigned char gchTermBusyLines; //Number of commands recieved
-    QString gstrTermBusyData; //Holds the recieved data for checking
-    QTimer *gpSignalTimer; //Handle for a timer to update COM port signals
-    QTimer *gpSystemTimeout; //Timer used to check if the process has timed out
+    QByteArray gbaTermBusyData; //Holds the recieved data for checking
+    DtmRingBuffer grbRXBuffer; //Serial port reads land here directly
+    DtmTimer *gpSignalTimer; //Handle for a timer to update COM port signals
+    DtmTimer *gpSystemTimeout; //Timer used to check if the process has timed out
     bool gbCTSStatus; //True when CTS is asserted
     QByteArray gbaDisplayBuffer; //Buffer of data to display
+    QTimer *gpDisplayTimer; //Timer used to redraw the terminal once per burst of received data
     quint8 gintProgramState; //Current position of the state machine
     bool gbExitOnFinish; //If the application should exit when complete or continue to run
-    QTimer *gpExitTimer; //Timer used to exit appliction in some instnces
+    DtmTimer *gpExitTimer; //Timer used to exit appliction in some instnces
 #ifdef TARGET_OS_MAC
-    QTimer *gpMacDoesntSupportCTSWorkaroundTimer; //A timer used to work around mac not having any working CTS read/update code
+    DtmTimer *gpMacDoesntSupportCTSWorkaroundTimer; //A timer used to work around mac not having any working CTS read/update code
 #endif
     int gintExitCode; //Exit code when program exists using above timer
     bool gbShowSerialErrors; //Used to supress serial port errors during opening
+    DtmTimer *gpRetryTimer; //Timer used to resend the exit DTM command
+    DtmTimer *gpResetPulseTimer; //Timer used to release the reset line after a pulse
+    quint8 gintRetryMaxAttempts; //Maximum number of times the exit DTM command is resent
+    quint16 gintRetryInitialInterval; //Time (in ms) until the first resend
+    quint16 gintRetryInterval; //Current resend interval (in ms), doubles after every resend
+    quint8 gintResetLine; //Modem line pulsed to reset the module before each resend
+    quint8 gintExitAttempts; //Number of times the exit DTM command has been sent to this module
+    DtmTraceWriter gtwTraceWriter; //Records serial traffic when tracing is enabled
+    DtmTraceReader gtrTraceReader; //Trace being replayed
+    DtmTraceRecord gdtrReplayRecord; //Next record of the trace to be replayed
+    DtmTimer *gpReplayTimer; //Timer used to step through the trace being replayed
+    bool gbReplayActive; //True when a trace is replayed instead of using a serial port
+    bool gbReplayPortOpen; //Simulated port state whilst replaying
+    bool gbReplayRealTime; //True to replay with the captured timing, false to replay as fast as possible
+    quint32 gintReplaySignals; //Simulated modem lines whilst replaying
+    quint32 gintTraceSignals; //Modem lines last written to the trace
+    QByteArray gbaReplayExpectedTX; //Data the trace recorded being sent
+    QByteArray gbaReplayActualTX; //Data sent whilst replaying
+    DtmMetrics gdmMetrics; //Counters and histograms for fleet monitoring
+    QString gstrMetricsFile; //File the metrics are written to (empty if disabled)
+    DtmTimer *gpMetricsTimer; //Timer used to periodically write the metrics file
+    DtmStopwatch gtmrStage; //Time since the current program state was entered
+    DtmStopwatch gtmrEscape; //Time since the escape was started
+    DtmStopwatch gtmrExitSent; //Time since the exit DTM command was last sent
+    QSettings *gpPersistentSettings; //Settings kept between runs (fixture history)
+    bool gbAutoBaud; //True to detect the baud rate and flow control after leaving DTM
+    QList<qint32> glstProbeBauds; //Candidate baud rates, most likely first
+    QList<quint8> glstProbeFlows; //Flow control of each candidate
+    int gintProbeIndex; //Index of the candidate currently being tried
+    DtmTimer *gpBaudProbeTimer; //Timer used to move on to the next candidate
+    QString gstrDetectedSetting; //Setting detected for the current module (baud_flow)
+    bool gbVerifyFirst; //True to check if the module is in DTM before escaping
+    bool gbEscapeSkipped; //True if the module was found to already be out of DTM
+    DtmTimer *gpVerifyTimer; //Timer used to wait for a response when checking if the module is in DTM
+    quint16 gintSignalPollInterval; //Time (in ms) between modem line polls, from the adapter profile
+    DtmHubScheduler ghsHubScheduler; //Limits concurrent escapes on the USB hub of the port
+    bool gbHubSchedule; //True to wait for a slot on the USB hub before escaping
+    DtmTimer *gpHubWaitTimer; //Timer used to retry getting (or handing back) a hub slot
+    DtmTimer *gpHubStaggerTimer; //Timer used to hold the hub opening lock after opening the port
+    QString gstrStartupBenchFile; //File startup timings are appended to (empty if disabled)
+    qint64 gintStartupConstructed; //Time (in ns) from process start until the window was constructed
+    qint64 gintStartupFirstTX; //Time (in ns) from process start until the first byte was sent, negative if none
+    DtmSession *gpSession; //Coroutine session escaping the module (NULL if not in use)
+    DtmTask gtskSession; //Escape coroutine running on the above session
+    DtmLicenseStore glsLicenseStore; //Licenses which can be installed on unlicensed modules
+    bool gbLicenseInstalled; //True once a license from the key file has been sent to this module
+    quint8 gintPoolTrigger; //Modem line used to detect a new module on a pooled port (PoolTriggerNone if not pooled)
+    bool gbPoolArmed; //True once the previous module has been removed from the pooled port
+    DtmStopwatch gtmrPoolSettle; //Time the trigger line has indicated a new module for
+    qint32 gintHighSpeedBaud; //Baud rate to switch the module to after the escape (0 if disabled)
+    QString gstrHighSpeedCommand; //Command which changes the UART rate of the module (%1 is replaced with the rate)
+    bool gbHighSpeedDone; //True once the switch-over has been attempted on this module
+    quint8 gintHighSpeedStep; //Current step of the switch-over
+    quint8 gintHighSpeedExpected; //Responses needed to finish the current step
+    qint32 gintHighSpeedOrigBaud; //Baud rate in use before the switch-over
+    QSerialPort::FlowControl gintHighSpeedOrigFlow; //Flow control in use before the switch-over
+    quint64 gintHighSpeedBefore; //Throughput (in bytes/s) measured at the original rate
+    DtmStopwatch gtmrHighSpeed; //Time since the current query was sent
+    DtmTimer *gpHighSpeedTimer; //Timer used to give up waiting for a response whilst switching
+    DtmLoopMonitor *gpLoopMonitor; //Measures event loop lag and handler durations
+    QStringList gslAllowedFirmware; //Firmware versions allowed to be erased (empty to allow any)
+    QStringList gslAllowedTypes; //Device types allowed to be erased (empty to allow any)
+    QSerialPort::BaudRate gintIdentifyBaud; //Baud rate the identity was queried at, erasing continues at it
+    QSerialPort::FlowControl gintIdentifyFlow; //Flow control the identity was queried with
+    DtmTimer *gpIdentifyTimer; //Timer used to give up waiting for the identity responses
+    DtmPortHealth gphPortHealth; //Stage time history of the port, used to flag and quarantine it
+    bool gbHealth; //True to track the health of the port
+    bool gbQuarantine; //True to quarantine the port when it is flagged
+    double gdblHealthDrift; //Multiple of the median stage time which flags the port
+    DtmStatusBlock gsbStatusBlock; //Live status of this port in shared memory for dashboards
+    DtmResultTable grtResultTable; //Supervisor table this worker publishes its state and result in
+    qint32 gintResultSlot; //Slot of this worker in the above table (negative if not supervised)
 };
 
 #endif // DTMMAINWINDOW_H
@@ -0,0 +1,533 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmMetrics.cpp
+**
+** Notes: Counters and histograms describing escapes, exported in the
+**        Prometheus text format. Updates are lock-free atomics.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include "DtmMetrics.h"
+#include <QFile>
+#include <QSaveFile>
+
+/******************************************************************************/
+// Local Variables
+/******************************************************************************/
+//Label values, indexed by program state and by -exit code
+static const char *const MetricsStageNames[] = {"idle", "exit_dtm", "erase_fs", "license_check", NULL, "baud_detect", "probe", "license_install", "high_speed", "identify"};
+static const char *const MetricsResultNames[] = {"ok", "invalid_port", "cts_asserted", "license_missing", "timeout", "serial_port_error", "invalid_trace", "worker_crashed", "quarantined", "identity_mismatch"};
+static const char *const MetricsHandlerNames[] = {"serial_read", "serial_status", "serial_error", "system_timeout", "retry_exit_dtm", "probe_next_baud", "verify_timeout", "hub_wait", "high_speed_timeout", "replay_step", "identify_timeout"};
+
+//Every state, result and handler needs a name or the exposition has duplicate series
+static_assert(sizeof(MetricsStageNames)/sizeof(MetricsStageNames[0]) == MetricsStages, "MetricsStageNames must name every stage");
+static_assert(sizeof(MetricsResultNames)/sizeof(MetricsResultNames[0]) == MetricsResults, "MetricsResultNames must name every result");
+static_assert(sizeof(MetricsHandlerNames)/sizeof(MetricsHandlerNames[0]) == MetricsHandlers, "MetricsHandlerNames must name every handler");
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+static void
+AppendHeader(
+    QByteArray *pbaOutput,
+    const char *pName,
+    const char *pType,
+    const char *pHelp
+    )
+{
+    //Adds the HELP and TYPE lines which precede a metric
+    pbaOutput->append("# HELP ").append(pName).append(" ").append(pHelp).append("\n");
+    pbaOutput->append("# TYPE ").append(pName).append(" ").append(pType).append("\n");
+}
+
+//=============================================================================
+//=============================================================================
+static QByteArray
+SeriesName(
+    const char *pName,
+    const char *pSuffix,
+    const QByteArray &baLabels
+    )
+{
+    //Returns the name of a series including its labels, e.g. name_suffix{a="b"}
+    QByteArray baSeries(pName);
+    baSeries.append(pSuffix);
+    if (baLabels.length() > 0)
+    {
+        baSeries.append("{").append(baLabels).append("}");
+    }
+    return baSeries;
+}
+
+//=============================================================================
+//=============================================================================
+static void
+AppendValue(
+    QByteArray *pbaOutput,
+    const QByteArray &baSeries,
+    quint64 intValue
+    )
+{
+    pbaOutput->append(baSeries).append(" ").append(QByteArray::number(intValue)).append("\n");
+}
+
+//=============================================================================
+//=============================================================================
+DtmHistogram::DtmHistogram(
+    )
+{
+    for (quint8 i = 0; i <= MetricsHistogramBuckets; ++i)
+    {
+        gintBuckets[i] = 0;
+    }
+    gintSum = 0;
+    gpBounds = MetricsHistogramBounds;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmHistogram::SetBounds(
+    const double *pBounds
+    )
+{
+    //Changes the bucket bounds, must be called before any observation
+    gpBounds = pBounds;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmHistogram::Observe(
+    qint64 intNanoseconds
+    )
+{
+    //Adds an observation to the bucket it falls in
+    quint8 i = 0;
+    while (i < MetricsHistogramBuckets && intNanoseconds > gpBounds[i]*1000000000.0)
+    {
+        ++i;
+    }
+    gintBuckets[i].fetch_add(1, std::memory_order_relaxed);
+    gintSum.fetch_add((quint64)(intNanoseconds < 0 ? 0 : intNanoseconds), std::memory_order_relaxed);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmHistogram::Append(
+    QByteArray *pbaOutput,
+    const char *pName,
+    const QByteArray &baLabels
+    ) const
+{
+    //Outputs the cumulative buckets, sum and count
+    QByteArray baPrefix = (baLabels.length() > 0 ? baLabels + "," : QByteArray());
+    quint64 intCumulative = 0;
+    for (quint8 i = 0; i <= MetricsHistogramBuckets; ++i)
+    {
+        intCumulative += gintBuckets[i].load(std::memory_order_relaxed);
+        QByteArray baBound = (i < MetricsHistogramBuckets ? QByteArray::number(gpBounds[i]) : QByteArray("+Inf"));
+        AppendValue(pbaOutput, SeriesName(pName, "_bucket", baPrefix + "le=\"" + baBound + "\""), intCumulative);
+    }
+    pbaOutput->append(SeriesName(pName, "_sum", baLabels)).append(" ").append(QByteArray::number((double)gintSum.load(std::memory_order_relaxed)/1000000000.0, 'f', 6)).append("\n");
+    AppendValue(pbaOutput, SeriesName(pName, "_count", baLabels), intCumulative);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmHistogram::Load(
+    const QHash<QByteArray, double> &hshValues,
+    const char *pName,
+    const QByteArray &baLabels
+    )
+{
+    //Restores the histogram from previously written values
+    QByteArray baPrefix = (baLabels.length() > 0 ? baLabels + "," : QByteArray());
+    quint64 intPrevious = 0;
+    for (quint8 i = 0; i <= MetricsHistogramBuckets; ++i)
+    {
+        QByteArray baBound = (i < MetricsHistogramBuckets ? QByteArray::number(gpBounds[i]) : QByteArray("+Inf"));
+        quint64 intCumulative = (quint64)hshValues.value(SeriesName(pName, "_bucket", baPrefix + "le=\"" + baBound + "\""), 0);
+        gintBuckets[i] = (intCumulative > intPrevious ? intCumulative - intPrevious : 0);
+        intPrevious = (intCumulative > intPrevious ? intCumulative : intPrevious);
+    }
+    gintSum = (quint64)(hshValues.value(SeriesName(pName, "_sum", baLabels), 0)*1000000000.0);
+}
+
+//=============================================================================
+//=============================================================================
+DtmMetrics::DtmMetrics(
+    )
+{
+    gintEscapesStarted = 0;
+    gintEscapesCompleted = 0;
+    for (quint8 i = 0; i < MetricsResults; ++i)
+    {
+        gintResults[i] = 0;
+    }
+    gintRXBytes = 0;
+    gintTXBytes = 0;
+    gintRetries = 0;
+    gintUSBResets = 0;
+    gintTXWrites = 0;
+    gintTXCommands = 0;
+    gintTXPending = 0;
+    gintLoopStalls = 0;
+    ghstLoopLag.SetBounds(MetricsLatencyBounds);
+    for (quint8 i = 0; i < MetricsHandlers; ++i)
+    {
+        ghstHandlers[i].SetBounds(MetricsLatencyBounds);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmMetrics::EscapeStarted(
+    )
+{
+    gintEscapesStarted.fetch_add(1, std::memory_order_relaxed);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmMetrics::EscapeCompleted(
+    qint64 intNanoseconds
+    )
+{
+    gintEscapesCompleted.fetch_add(1, std::memory_order_relaxed);
+    ghstEscape.Observe(intNanoseconds);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmMetrics::Result(
+    int intExitCode
+    )
+{
+    if (intExitCode <= 0 && -intExitCode < MetricsResults)
+    {
+        gintResults[-intExitCode].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmMetrics::StageCompleted(
+    quint8 intStage,
+    qint64 intNanoseconds
+    )
+{
+    if (intStage < MetricsStages)
+    {
+        ghstStages[intStage].Observe(intNanoseconds);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmMetrics::CTSWait(
+    qint64 intNanoseconds
+    )
+{
+    ghstCTSWait.Observe(intNanoseconds);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmMetrics::BytesReceived(
+    quint64 intBytes
+    )
+{
+    gintRXBytes.fetch_add(intBytes, std::memory_order_relaxed);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmMetrics::BytesSent(
+    quint64 intBytes
+    )
+{
+    gintTXBytes.fetch_add(intBytes, std::memory_order_relaxed);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmMetrics::TXWrite(
+    )
+{
+    gintTXWrites.fetch_add(1, std::memory_order_relaxed);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmMetrics::TXCommand(
+    )
+{
+    gintTXCommands.fetch_add(1, std::memory_order_relaxed);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmMetrics::TXPending(
+    quint64 intBytes
+    )
+{
+    gintTXPending.store(intBytes, std::memory_order_relaxed);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmMetrics::Retry(
+    )
+{
+    gintRetries.fetch_add(1, std::memory_order_relaxed);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmMetrics::USBReset(
+    )
+{
+    gintUSBResets.fetch_add(1, std::memory_order_relaxed);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmMetrics::LoopLag(
+    qint64 intNanoseconds
+    )
+{
+    ghstLoopLag.Observe(intNanoseconds);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmMetrics::LoopStall(
+    )
+{
+    gintLoopStalls.fetch_add(1, std::memory_order_relaxed);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmMetrics::HandlerCompleted(
+    quint8 intHandler,
+    qint64 intNanoseconds
+    )
+{
+    if (intHandler < MetricsHandlers)
+    {
+        ghstHandlers[intHandler].Observe(intNanoseconds);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+const char *
+DtmMetrics::HandlerName(
+    quint8 intHandler
+    )
+{
+    //Returns the label of an event loop handler
+    return (intHandler < MetricsHandlers ? MetricsHandlerNames[intHandler] : "unknown");
+}
+
+//=============================================================================
+//=============================================================================
+const char *
+DtmMetrics::ResultName(
+    int intExitCode
+    )
+{
+    //Returns the label of an exit code
+    return (intExitCode <= 0 && -intExitCode < MetricsResults ? MetricsResultNames[-intExitCode] : "unknown");
+}
+
+//=============================================================================
+//=============================================================================
+const char *
+DtmMetrics::StageName(
+    quint8 intStage
+    )
+{
+    //Returns the label of a program state, or NULL if it is not tracked
+    return (intStage < MetricsStages ? MetricsStageNames[intStage] : NULL);
+}
+
+//=============================================================================
+//=============================================================================
+QByteArray
+DtmMetrics::PrometheusText(
+    ) const
+{
+    //Outputs all metrics in the Prometheus text exposition format
+    QByteArray baOutput;
+
+    AppendHeader(&baOutput, "exitdtm_escapes_started_total", "counter", "Number of DTM escapes started.");
+    AppendValue(&baOutput, "exitdtm_escapes_started_total", gintEscapesStarted.load(std::memory_order_relaxed));
+    AppendHeader(&baOutput, "exitdtm_escapes_completed_total", "counter", "Number of DTM escapes which completed.");
+    AppendValue(&baOutput, "exitdtm_escapes_completed_total", gintEscapesCompleted.load(std::memory_order_relaxed));
+
+    AppendHeader(&baOutput, "exitdtm_results_total", "counter", "Number of escapes finishing with each result.");
+    for (quint8 i = 0; i < MetricsResults; ++i)
+    {
+        AppendValue(&baOutput, SeriesName("exitdtm_results_total", "", QByteArray("result=\"").append(MetricsResultNames[i]).append("\"")), gintResults[i].load(std::memory_order_relaxed));
+    }
+
+    AppendHeader(&baOutput, "exitdtm_rx_bytes_total", "counter", "Bytes received from modules.");
+    AppendValue(&baOutput, "exitdtm_rx_bytes_total", gintRXBytes.load(std::memory_order_relaxed));
+    AppendHeader(&baOutput, "exitdtm_tx_bytes_total", "counter", "Bytes sent to modules.");
+    AppendValue(&baOutput, "exitdtm_tx_bytes_total", gintTXBytes.load(std::memory_order_relaxed));
+    AppendHeader(&baOutput, "exitdtm_tx_writes_total", "counter", "Writes submitted to the serial port.");
+    AppendValue(&baOutput, "exitdtm_tx_writes_total", gintTXWrites.load(std::memory_order_relaxed));
+    AppendHeader(&baOutput, "exitdtm_tx_commands_total", "counter", "Commands sent to modules.");
+    AppendValue(&baOutput, "exitdtm_tx_commands_total", gintTXCommands.load(std::memory_order_relaxed));
+    AppendHeader(&baOutput, "exitdtm_tx_pending_bytes", "gauge", "Bytes handed to the serial port which have not been written yet.");
+    AppendValue(&baOutput, "exitdtm_tx_pending_bytes", gintTXPending.load(std::memory_order_relaxed));
+    AppendHeader(&baOutput, "exitdtm_exit_retries_total", "counter", "Number of times the exit DTM command was resent.");
+    AppendValue(&baOutput, "exitdtm_exit_retries_total", gintRetries.load(std::memory_order_relaxed));
+    AppendHeader(&baOutput, "exitdtm_usb_resets_total", "counter", "Number of times the serial device was lost whilst open.");
+    AppendValue(&baOutput, "exitdtm_usb_resets_total", gintUSBResets.load(std::memory_order_relaxed));
+
+    AppendHeader(&baOutput, "exitdtm_stage_duration_seconds", "histogram", "Time spent in each stage of an escape, whatever its result.");
+    for (quint8 i = 1; i < MetricsStages; ++i)
+    {
+        if (MetricsStageNames[i] == NULL)
+        {
+            continue;
+        }
+        ghstStages[i].Append(&baOutput, "exitdtm_stage_duration_seconds", QByteArray("stage=\"").append(MetricsStageNames[i]).append("\""));
+    }
+    AppendHeader(&baOutput, "exitdtm_cts_wait_seconds", "histogram", "Time from the last exit DTM command until CTS was asserted.");
+    ghstCTSWait.Append(&baOutput, "exitdtm_cts_wait_seconds", QByteArray());
+    AppendHeader(&baOutput, "exitdtm_escape_duration_seconds", "histogram", "Time taken by escapes which completed.");
+    ghstEscape.Append(&baOutput, "exitdtm_escape_duration_seconds", QByteArray());
+
+    AppendHeader(&baOutput, "exitdtm_loop_stalls_total", "counter", "Number of times the event loop lag exceeded the warning threshold.");
+    AppendValue(&baOutput, "exitdtm_loop_stalls_total", gintLoopStalls.load(std::memory_order_relaxed));
+    AppendHeader(&baOutput, "exitdtm_loop_lag_seconds", "histogram", "Delay dispatching the event loop heartbeat.");
+    ghstLoopLag.Append(&baOutput, "exitdtm_loop_lag_seconds", QByteArray());
+    AppendHeader(&baOutput, "exitdtm_handler_duration_seconds", "histogram", "Time spent in each event loop handler.");
+    for (quint8 i = 0; i < MetricsHandlers; ++i)
+    {
+        ghstHandlers[i].Append(&baOutput, "exitdtm_handler_duration_seconds", QByteArray("handler=\"").append(MetricsHandlerNames[i]).append("\""));
+    }
+
+    return baOutput;
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmMetrics::Load(
+    const QString &strFilename
+    )
+{
+    //Restores metrics from a previously written file so counters continue across runs
+    QFile fileMetrics(strFilename);
+    if (!fileMetrics.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    QHash<QByteArray, double> hshValues;
+    while (!fileMetrics.atEnd())
+    {
+        QByteArray baLine = fileMetrics.readLine().trimmed();
+        int intSplit = baLine.lastIndexOf(' ');
+        if (baLine.length() > 0 && baLine.at(0) != '#' && intSplit > 0)
+        {
+            hshValues.insert(baLine.left(intSplit), baLine.mid(intSplit + 1).toDouble());
+        }
+    }
+
+    gintEscapesStarted = (quint64)hshValues.value("exitdtm_escapes_started_total", 0);
+    gintEscapesCompleted = (quint64)hshValues.value("exitdtm_escapes_completed_total", 0);
+    for (quint8 i = 0; i < MetricsResults; ++i)
+    {
+        gintResults[i] = (quint64)hshValues.value(SeriesName("exitdtm_results_total", "", QByteArray("result=\"").append(MetricsResultNames[i]).append("\"")), 0);
+    }
+    gintRXBytes = (quint64)hshValues.value("exitdtm_rx_bytes_total", 0);
+    gintTXBytes = (quint64)hshValues.value("exitdtm_tx_bytes_total", 0);
+    gintTXWrites = (quint64)hshValues.value("exitdtm_tx_writes_total", 0);
+    gintTXCommands = (quint64)hshValues.value("exitdtm_tx_commands_total", 0);
+    gintRetries = (quint64)hshValues.value("exitdtm_exit_retries_total", 0);
+    gintUSBResets = (quint64)hshValues.value("exitdtm_usb_resets_total", 0);
+    for (quint8 i = 1; i < MetricsStages; ++i)
+    {
+        if (MetricsStageNames[i] == NULL)
+        {
+            continue;
+        }
+        ghstStages[i].Load(hshValues, "exitdtm_stage_duration_seconds", QByteArray("stage=\"").append(MetricsStageNames[i]).append("\""));
+    }
+    ghstCTSWait.Load(hshValues, "exitdtm_cts_wait_seconds", QByteArray());
+    ghstEscape.Load(hshValues, "exitdtm_escape_duration_seconds", QByteArray());
+    gintLoopStalls = (quint64)hshValues.value("exitdtm_loop_stalls_total", 0);
+    ghstLoopLag.Load(hshValues, "exitdtm_loop_lag_seconds", QByteArray());
+    for (quint8 i = 0; i < MetricsHandlers; ++i)
+    {
+        ghstHandlers[i].Load(hshValues, "exitdtm_handler_duration_seconds", QByteArray("handler=\"").append(MetricsHandlerNames[i]).append("\""));
+    }
+
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmMetrics::Write(
+    const QString &strFilename,
+    const QByteArray &baExtra
+    ) const
+{
+    //Replaces the metrics file atomically so a collector never reads a partial file, baExtra is
+    //appended as is (e.g. the port health summary)
+    QSaveFile fileMetrics(strFilename);
+    if (!fileMetrics.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    fileMetrics.write(PrometheusText());
+    fileMetrics.write(baExtra);
+    return fileMetrics.commit();
+}
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
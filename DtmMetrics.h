@@ -0,0 +1,203 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmMetrics.h
+**
+** Notes: Counters and histograms describing escapes, exported in the
+**        Prometheus text format. Updates are lock-free atomics.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMMETRICS_H
+#define DTMMETRICS_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+#include <atomic>
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+const quint8                   MetricsHistogramBuckets    = 12; //Number of finite histogram buckets
+const double                   MetricsHistogramBounds[MetricsHistogramBuckets] = {0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 15.0, 30.0}; //Upper bounds (in seconds) of the histogram buckets
+const double                   MetricsLatencyBounds[MetricsHistogramBuckets] = {0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.25, 0.5, 1.0, 5.0}; //Upper bounds (in seconds) of the event loop histogram buckets
+const quint8                   MetricsStages              = 10; //Number of program states (including idle) tracked per stage
+const quint8                   MetricsResults             = 10; //Number of exit codes tracked (0 to -9)
+const quint16                  MetricsWriteInterval       = 5000; //Time (in ms) between writes of the metrics file
+
+//Event loop handlers timed by the loop monitor
+const quint8                   MetricsHandlerSerialRead   = 0;
+const quint8                   MetricsHandlerSerialStatus = 1;
+const quint8                   MetricsHandlerSerialError  = 2;
+const quint8                   MetricsHandlerSystemTimeout = 3;
+const quint8                   MetricsHandlerRetryExitDTM = 4;
+const quint8                   MetricsHandlerProbeNextBaud = 5;
+const quint8                   MetricsHandlerVerifyTimeout = 6;
+const quint8                   MetricsHandlerHubWait      = 7;
+const quint8                   MetricsHandlerHighSpeedTimeout = 8;
+const quint8                   MetricsHandlerReplayStep   = 9;
+const quint8                   MetricsHandlerIdentifyTimeout = 10;
+const quint8                   MetricsHandlers            = 11; //Number of handlers tracked
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+class DtmHistogram
+{
+public:
+    DtmHistogram(
+        );
+    void
+    SetBounds(
+        const double *pBounds
+        );
+    void
+    Observe(
+        qint64 intNanoseconds
+        );
+    void
+    Append(
+        QByteArray *pbaOutput,
+        const char *pName,
+        const QByteArray &baLabels
+        ) const;
+    void
+    Load(
+        const QHash<QByteArray, double> &hshValues,
+        const char *pName,
+        const QByteArray &baLabels
+        );
+
+private:
+    std::atomic<quint64> gintBuckets[MetricsHistogramBuckets+1]; //Observations per bucket (last is +Inf), not cumulative
+    std::atomic<quint64> gintSum; //Sum of all observations (in ns)
+    const double *gpBounds; //Upper bounds (in seconds) of the buckets
+};
+
+class DtmMetrics
+{
+public:
+    DtmMetrics(
+        );
+    void
+    EscapeStarted(
+        );
+    void
+    EscapeCompleted(
+        qint64 intNanoseconds
+        );
+    void
+    Result(
+        int intExitCode
+        );
+    void
+    StageCompleted(
+        quint8 intStage,
+        qint64 intNanoseconds
+        );
+    void
+    CTSWait(
+        qint64 intNanoseconds
+        );
+    void
+    BytesReceived(
+        quint64 intBytes
+        );
+    void
+    BytesSent(
+        quint64 intBytes
+        );
+    void
+    TXWrite(
+        );
+    void
+    TXCommand(
+        );
+    void
+    TXPending(
+        quint64 intBytes
+        );
+    void
+    Retry(
+        );
+    void
+    USBReset(
+        );
+    void
+    LoopLag(
+        qint64 intNanoseconds
+        );
+    void
+    LoopStall(
+        );
+    void
+    HandlerCompleted(
+        quint8 intHandler,
+        qint64 intNanoseconds
+        );
+    static const char *
+    HandlerName(
+        quint8 intHandler
+        );
+    QByteArray
+    PrometheusText(
+        ) const;
+    static const char *
+    StageName(
+        quint8 intStage
+        );
+    static const char *
+    ResultName(
+        int intExitCode
+        );
+    bool
+    Load(
+        const QString &strFilename
+        );
+    bool
+    Write(
+        const QString &strFilename,
+        const QByteArray &baExtra = QByteArray()
+        ) const;
+
+private:
+    std::atomic<quint64> gintEscapesStarted; //Number of escapes started
+    std::atomic<quint64> gintEscapesCompleted; //Number of escapes which left DTM mode successfully
+    std::atomic<quint64> gintResults[MetricsResults]; //Number of times each exit code has been the result, indexed by -code
+    std::atomic<quint64> gintRXBytes; //Bytes received
+    std::atomic<quint64> gintTXBytes; //Bytes sent
+    std::atomic<quint64> gintRetries; //Number of times the exit DTM command was resent
+    std::atomic<quint64> gintTXWrites; //Number of writes submitted to the serial port
+    std::atomic<quint64> gintTXCommands; //Number of commands sent to modules
+    std::atomic<quint64> gintTXPending; //Bytes handed to the serial port which have not been written yet (a gauge, not restored by Load)
+    std::atomic<quint64> gintUSBResets; //Number of times the serial device disappeared whilst open
+    std::atomic<quint64> gintLoopStalls; //Number of times the event loop lag exceeded the warning threshold
+    DtmHistogram ghstStages[MetricsStages]; //Duration of each program state
+    DtmHistogram ghstCTSWait; //Time from the last exit DTM command until CTS was asserted
+    DtmHistogram ghstEscape; //Duration of successful escapes
+    DtmHistogram ghstLoopLag; //Delay dispatching the event loop heartbeat
+    DtmHistogram ghstHandlers[MetricsHandlers]; //Time spent in each event loop handler
+};
+
+#endif // DTMMETRICS_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
@@ -0,0 +1,439 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmPortHealth.cpp
+**
+** Notes: Per port stage latency history (an average and a quantile sketch
+**        of each stage) kept between runs, used to flag ports which are
+**        drifting slower and optionally quarantine them.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include "DtmPortHealth.h"
+#include "DtmConstants.h"
+#include <math.h>
+#include <string.h>
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+DtmPortHealth::DtmPortHealth(
+    )
+{
+    gpSettings = NULL;
+    gdblDrift = HealthDefaultDrift;
+    gbQuarantine = false;
+    memset(gshStages, 0, sizeof(gshStages));
+    gintTimeouts = 0;
+    gbDrifting = false;
+    gbQuarantined = false;
+}
+
+//=============================================================================
+//=============================================================================
+QString
+DtmPortHealth::PortKey(
+    const QString &strPort
+    )
+{
+    //Settings group of a port, path separators would otherwise nest groups
+    return QString("Health/").append(QString(strPort).replace("/", "_").replace("\\", "_").replace(":", "_")).append("/");
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmPortHealth::IsQuarantined(
+    QSettings *pSettings,
+    const QString &strPort
+    )
+{
+    //Checks a port without loading its history (supervisor)
+    return pSettings->value(QString(PortKey(strPort)).append("Quarantined"), false).toBool();
+}
+
+//=============================================================================
+//=============================================================================
+QString
+DtmPortHealth::Reason(
+    QSettings *pSettings,
+    const QString &strPort
+    )
+{
+    return pSettings->value(QString(PortKey(strPort)).append("Reason"), "").toString();
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmPortHealth::Setup(
+    QSettings *pSettings,
+    const QString &strPort,
+    double dblDrift,
+    bool bQuarantine
+    )
+{
+    //Selects the port to track and loads its history
+    gpSettings = pSettings;
+    gstrPort = strPort;
+    gstrGroup = PortKey(strPort);
+    gdblDrift = dblDrift;
+    gbQuarantine = bQuarantine;
+    Load();
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmPortHealth::IsSetup(
+    ) const
+{
+    return (gpSettings != NULL);
+}
+
+//=============================================================================
+//=============================================================================
+QString
+DtmPortHealth::Port(
+    ) const
+{
+    return gstrPort;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmPortHealth::Load(
+    )
+{
+    //Reads the history of the port, missing entries start empty
+    memset(gshStages, 0, sizeof(gshStages));
+    gpSettings->sync();
+    quint8 i = 0;
+    while (i < MetricsStages)
+    {
+        if (DtmMetrics::StageName(i) != NULL)
+        {
+            QString strStage = QString(gstrGroup).append(DtmMetrics::StageName(i)).append("/");
+            gshStages[i].intCount = gpSettings->value(QString(strStage).append("Count"), 0).toUInt();
+            gshStages[i].intAverage = gpSettings->value(QString(strStage).append("Average"), 0).toLongLong();
+            QStringList slSketch = gpSettings->value(QString(strStage).append("Sketch"), "").toString().split(',');
+            quint8 j = 0;
+            while (j < HealthSketchBuckets && j < slSketch.length())
+            {
+                gshStages[i].intSketch[j] = slSketch[j].toUInt();
+                ++j;
+            }
+        }
+        ++i;
+    }
+    gintTimeouts = (quint8)gpSettings->value(QString(gstrGroup).append("Timeouts"), 0).toUInt();
+    gbDrifting = gpSettings->value(QString(gstrGroup).append("Drifting"), false).toBool();
+    gbQuarantined = gpSettings->value(QString(gstrGroup).append("Quarantined"), false).toBool();
+    gstrReason = gpSettings->value(QString(gstrGroup).append("Reason"), "").toString();
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmPortHealth::Save(
+    )
+{
+    //Writes the history of the port, once per module
+    quint8 i = 0;
+    while (i < MetricsStages)
+    {
+        if (DtmMetrics::StageName(i) != NULL && gshStages[i].intCount > 0)
+        {
+            QString strStage = QString(gstrGroup).append(DtmMetrics::StageName(i)).append("/");
+            QStringList slSketch;
+            quint8 j = 0;
+            while (j < HealthSketchBuckets)
+            {
+                slSketch.append(QString::number(gshStages[i].intSketch[j]));
+                ++j;
+            }
+            gpSettings->setValue(QString(strStage).append("Count"), gshStages[i].intCount);
+            gpSettings->setValue(QString(strStage).append("Average"), gshStages[i].intAverage);
+            gpSettings->setValue(QString(strStage).append("Sketch"), slSketch.join(","));
+        }
+        ++i;
+    }
+    gpSettings->setValue(QString(gstrGroup).append("Timeouts"), gintTimeouts);
+    gpSettings->setValue(QString(gstrGroup).append("Drifting"), gbDrifting);
+    gpSettings->setValue(QString(gstrGroup).append("Quarantined"), gbQuarantined);
+    gpSettings->setValue(QString(gstrGroup).append("Reason"), gstrReason);
+    gpSettings->sync();
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmPortHealth::Reset(
+    )
+{
+    //Forgets the history of the port, e.g. after the fixture has been repaired
+    if (gpSettings == NULL)
+    {
+        return;
+    }
+    gpSettings->remove(gstrGroup.left(gstrGroup.length()-1));
+    gpSettings->sync();
+    Load();
+}
+
+//=============================================================================
+//=============================================================================
+quint8
+DtmPortHealth::Bucket(
+    qint64 intNanoseconds
+    )
+{
+    //Bucket 0 is under 1 ms, bucket n covers 2^((n-1)/2) to 2^(n/2) ms
+    double dblMilliseconds = (double)intNanoseconds/1000000.0;
+    if (dblMilliseconds < 1.0)
+    {
+        return 0;
+    }
+    int intBucket = 1 + (int)floor(2.0*log2(dblMilliseconds));
+    return (quint8)qMin(intBucket, (int)HealthSketchBuckets - 1);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmPortHealth::StageCompleted(
+    quint8 intStage,
+    qint64 intNanoseconds
+    )
+{
+    //Adds a stage time to the average and sketch
+    if (gpSettings == NULL || intStage >= MetricsStages)
+    {
+        return;
+    }
+    DtmStageHealth *pStage = &gshStages[intStage];
+    pStage->intAverage = (pStage->intCount == 0 ? intNanoseconds : (pStage->intAverage*(HealthAverageWeight-1) + intNanoseconds)/HealthAverageWeight);
+    ++pStage->intCount;
+    ++pStage->intSketch[Bucket(intNanoseconds)];
+
+    quint32 intTotal = 0;
+    quint8 i = 0;
+    while (i < HealthSketchBuckets)
+    {
+        intTotal += pStage->intSketch[i];
+        ++i;
+    }
+    if (intTotal > HealthSketchLimit)
+    {
+        //Halve everything so the sketch follows the recent history of the port
+        i = 0;
+        while (i < HealthSketchBuckets)
+        {
+            pStage->intSketch[i] /= 2;
+            ++i;
+        }
+    }
+}
+
+//=============================================================================
+//=============================================================================
+double
+DtmPortHealth::Quantile(
+    quint8 intStage,
+    double dblQuantile
+    ) const
+{
+    //Estimates a quantile of a stage time (in seconds) from the middle of the bucket it falls in
+    if (intStage >= MetricsStages)
+    {
+        return 0.0;
+    }
+    const DtmStageHealth *pStage = &gshStages[intStage];
+    quint32 intTotal = 0;
+    quint8 i = 0;
+    while (i < HealthSketchBuckets)
+    {
+        intTotal += pStage->intSketch[i];
+        ++i;
+    }
+    if (intTotal == 0)
+    {
+        return 0.0;
+    }
+
+    double dblTarget = dblQuantile*intTotal;
+    quint32 intCumulative = 0;
+    i = 0;
+    while (i < HealthSketchBuckets - 1)
+    {
+        intCumulative += pStage->intSketch[i];
+        if (intCumulative >= dblTarget)
+        {
+            break;
+        }
+        ++i;
+    }
+    return (i == 0 ? 0.0005 : pow(2.0, ((double)i - 0.5)/2.0)/1000.0);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmPortHealth::Evaluate(
+    )
+{
+    //Flags the port if any stage has crept above its median or it keeps timing out
+    QStringList slReasons;
+    quint8 i = 0;
+    while (i < MetricsStages)
+    {
+        if (DtmMetrics::StageName(i) != NULL && gshStages[i].intCount >= HealthMinSamples)
+        {
+            double dblMedian = Quantile(i, 0.5);
+            double dblAverage = (double)gshStages[i].intAverage/1000000000.0;
+            if (dblAverage > dblMedian*gdblDrift)
+            {
+                slReasons.append(QString(DtmMetrics::StageName(i)).append(" averaging ").append(QString::number(dblAverage, 'f', 3)).append("s against a median of ").append(QString::number(dblMedian, 'f', 3)).append("s"));
+            }
+        }
+        ++i;
+    }
+    if (gintTimeouts >= HealthTimeoutStreak)
+    {
+        slReasons.append(QString::number(gintTimeouts).append(" consecutive timeouts"));
+    }
+
+    gbDrifting = (slReasons.length() > 0);
+    gstrReason = slReasons.join(", ");
+    if (gbDrifting == true && gbQuarantine == true)
+    {
+        //Stays quarantined until the history is reset
+        gbQuarantined = true;
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmPortHealth::Result(
+    int intExitCode
+    )
+{
+    //Updates the timeout streak, re-evaluates the port and saves its history
+    if (gpSettings == NULL || intExitCode == ExitCodeQuarantined)
+    {
+        return;
+    }
+    if (intExitCode == ExitCodeTimeout)
+    {
+        gintTimeouts = (gintTimeouts < 0xff ? gintTimeouts + 1 : gintTimeouts);
+    }
+    else if (intExitCode == ExitCodeOK || intExitCode == ExitCodeLicenseMissing)
+    {
+        gintTimeouts = 0;
+    }
+    Evaluate();
+    Save();
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmPortHealth::IsDrifting(
+    ) const
+{
+    return gbDrifting;
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmPortHealth::IsQuarantined(
+    ) const
+{
+    return gbQuarantined;
+}
+
+//=============================================================================
+//=============================================================================
+QString
+DtmPortHealth::Reason(
+    ) const
+{
+    return gstrReason;
+}
+
+//=============================================================================
+//=============================================================================
+QByteArray
+DtmPortHealth::PrometheusText(
+    ) const
+{
+    //Health summary of the port, appended to the metrics file
+    QByteArray baOutput;
+    if (gpSettings == NULL)
+    {
+        return baOutput;
+    }
+    QByteArray baPort = QString("port=\"").append(gstrPort).append("\"").toUtf8();
+
+    baOutput.append("# HELP exitdtm_port_stage_average_seconds Exponentially weighted average time spent in each program state on this port.\n");
+    baOutput.append("# TYPE exitdtm_port_stage_average_seconds gauge\n");
+    quint8 i = 0;
+    while (i < MetricsStages)
+    {
+        if (DtmMetrics::StageName(i) != NULL && gshStages[i].intCount > 0)
+        {
+            baOutput.append("exitdtm_port_stage_average_seconds{").append(baPort).append(",stage=\"").append(DtmMetrics::StageName(i)).append("\"} ").append(QByteArray::number((double)gshStages[i].intAverage/1000000000.0, 'f', 6)).append("\n");
+        }
+        ++i;
+    }
+
+    baOutput.append("# HELP exitdtm_port_stage_seconds Quantiles of the time spent in each program state on this port.\n");
+    baOutput.append("# TYPE exitdtm_port_stage_seconds gauge\n");
+    const double dblQuantiles[] = {0.5, 0.9, 0.99};
+    i = 0;
+    while (i < MetricsStages)
+    {
+        if (DtmMetrics::StageName(i) != NULL && gshStages[i].intCount > 0)
+        {
+            quint8 j = 0;
+            while (j < sizeof(dblQuantiles)/sizeof(dblQuantiles[0]))
+            {
+                baOutput.append("exitdtm_port_stage_seconds{").append(baPort).append(",stage=\"").append(DtmMetrics::StageName(i)).append("\",quantile=\"").append(QByteArray::number(dblQuantiles[j])).append("\"} ").append(QByteArray::number(Quantile(i, dblQuantiles[j]), 'f', 6)).append("\n");
+                ++j;
+            }
+        }
+        ++i;
+    }
+
+    baOutput.append("# HELP exitdtm_port_drifting 1 if stage times on this port have crept up or it keeps timing out.\n");
+    baOutput.append("# TYPE exitdtm_port_drifting gauge\n");
+    baOutput.append("exitdtm_port_drifting{").append(baPort).append("} ").append(gbDrifting == true ? "1" : "0").append("\n");
+    baOutput.append("# HELP exitdtm_port_quarantined 1 if this port has been taken out of service.\n");
+    baOutput.append("# TYPE exitdtm_port_quarantined gauge\n");
+    baOutput.append("exitdtm_port_quarantined{").append(baPort).append("} ").append(gbQuarantined == true ? "1" : "0").append("\n");
+    return baOutput;
+}
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
@@ -0,0 +1,151 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmPortHealth.h
+**
+** Notes: Per port stage latency history (an average and a quantile sketch
+**        of each stage) kept between runs, used to flag ports which are
+**        drifting slower and optionally quarantine them.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMPORTHEALTH_H
+#define DTMPORTHEALTH_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QSettings>
+#include <QString>
+#include "DtmMetrics.h"
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+const quint8                   HealthSketchBuckets        = 32; //Latency buckets per stage, each sqrt(2) times wider than the last from 1 ms
+const quint16                  HealthSketchLimit          = 1024; //Samples in a sketch before every bucket is halved, so old samples fade out
+const quint8                   HealthAverageWeight        = 8; //Weight of the previous average stage time (1/n of new samples)
+const quint8                   HealthMinSamples           = 20; //Samples of a stage needed before it can be flagged
+const double                   HealthDefaultDrift         = 1.5; //Stages averaging more than this multiple of their median are flagged
+const quint8                   HealthTimeoutStreak        = 3; //Consecutive timeouts which flag a port
+
+/******************************************************************************/
+// Structures
+/******************************************************************************/
+struct DtmStageHealth
+{
+    quint32 intCount; //Number of samples
+    qint64 intAverage; //Exponentially weighted average (in ns)
+    quint32 intSketch[HealthSketchBuckets]; //Number of samples in each latency bucket
+};
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+class DtmPortHealth
+{
+public:
+    DtmPortHealth(
+        );
+    static QString
+    PortKey(
+        const QString &strPort
+        );
+    static bool
+    IsQuarantined(
+        QSettings *pSettings,
+        const QString &strPort
+        );
+    static QString
+    Reason(
+        QSettings *pSettings,
+        const QString &strPort
+        );
+    void
+    Setup(
+        QSettings *pSettings,
+        const QString &strPort,
+        double dblDrift,
+        bool bQuarantine
+        );
+    bool
+    IsSetup(
+        ) const;
+    QString
+    Port(
+        ) const;
+    void
+    Reset(
+        );
+    void
+    StageCompleted(
+        quint8 intStage,
+        qint64 intNanoseconds
+        );
+    void
+    Result(
+        int intExitCode
+        );
+    bool
+    IsDrifting(
+        ) const;
+    bool
+    IsQuarantined(
+        ) const;
+    QString
+    Reason(
+        ) const;
+    double
+    Quantile(
+        quint8 intStage,
+        double dblQuantile
+        ) const;
+    QByteArray
+    PrometheusText(
+        ) const;
+
+private:
+    void
+    Load(
+        );
+    void
+    Save(
+        );
+    void
+    Evaluate(
+        );
+    static quint8
+    Bucket(
+        qint64 intNanoseconds
+        );
+
+    QSettings *gpSettings; //Settings shared between instances, holds the history of each port
+    QString gstrPort; //Port being tracked
+    QString gstrGroup; //Settings group of the port
+    double gdblDrift; //Multiple of the median a stage average must exceed to be flagged
+    bool gbQuarantine; //True to quarantine the port once it is flagged
+    DtmStageHealth gshStages[MetricsStages]; //History of each program state
+    quint8 gintTimeouts; //Consecutive timeouts
+    bool gbDrifting; //True if the port is flagged
+    bool gbQuarantined; //True if the port has been quarantined
+    QString gstrReason; //Why the port is flagged (empty if not)
+};
+
+#endif // DTMPORTHEALTH_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
@@ -0,0 +1,212 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmResultTable.cpp
+**
+** Notes: Shared memory table of per-port state and results. Each slot has
+**        a single writer (the worker escaping that port) and is updated
+**        seqlock style so readers never block it or see a torn entry.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include "DtmResultTable.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <string.h>
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+DtmResultTable::DtmResultTable(
+    )
+{
+    gintSlots = 0;
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmResultTable::Create(
+    const QString &strKey,
+    quint32 intSlots
+    )
+{
+    //Creates an empty table (supervisor)
+    if (intSlots == 0 || intSlots > ResultTableMaxSlots)
+    {
+        return false;
+    }
+    gshmTable.setKey(strKey);
+    if (gshmTable.create(sizeof(DtmResultHeader) + intSlots*sizeof(DtmResultSlot)) == false)
+    {
+        return false;
+    }
+
+    memset(gshmTable.data(), 0, gshmTable.size());
+    DtmResultHeader *pHeader = (DtmResultHeader *)gshmTable.data();
+    pHeader->intVersion = ResultTableVersion;
+    pHeader->intSlots = intSlots;
+    gintSlots = intSlots;
+    quint32 i = 0;
+    while (i < intSlots)
+    {
+        Reset(i, "");
+        ++i;
+    }
+
+    //Mark as ready last, workers check this when attaching
+    DtmSeqLock::MarkReady(&pHeader->intMagic, ResultTableMagic);
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmResultTable::Attach(
+    const QString &strKey
+    )
+{
+    //Attaches to a table created by the supervisor (worker)
+    gshmTable.setKey(strKey);
+    if (gshmTable.attach() == false)
+    {
+        return false;
+    }
+    const DtmResultHeader *pHeader = (const DtmResultHeader *)gshmTable.constData();
+    if (gshmTable.size() < (int)sizeof(DtmResultHeader) || DtmSeqLock::IsReady(&pHeader->intMagic, ResultTableMagic) == false || pHeader->intVersion != ResultTableVersion || gshmTable.size() < (int)(sizeof(DtmResultHeader) + pHeader->intSlots*sizeof(DtmResultSlot)))
+    {
+        gshmTable.detach();
+        return false;
+    }
+    gintSlots = pHeader->intSlots;
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmResultTable::IsAttached(
+    ) const
+{
+    return (gshmTable.isAttached() == true && gintSlots > 0);
+}
+
+//=============================================================================
+//=============================================================================
+quint32
+DtmResultTable::Slots(
+    ) const
+{
+    return gintSlots;
+}
+
+//=============================================================================
+//=============================================================================
+DtmResultSlot *
+DtmResultTable::Slot(
+    quint32 intSlot
+    ) const
+{
+    //Returns a slot, or NULL if out of range
+    if (IsAttached() == false || intSlot >= gintSlots)
+    {
+        return NULL;
+    }
+    return (DtmResultSlot *)((char *)gshmTable.constData() + sizeof(DtmResultHeader) + intSlot*sizeof(DtmResultSlot));
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmResultTable::Write(
+    quint32 intSlot,
+    const DtmResultEntry &dreEntry
+    )
+{
+    //Only one process writes each slot
+    DtmResultSlot *pSlot = Slot(intSlot);
+    if (pSlot == NULL)
+    {
+        return;
+    }
+    DtmSeqLock::Write(&pSlot->intSequence, &pSlot->dreEntry, &dreEntry, sizeof(DtmResultEntry));
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmResultTable::Reset(
+    quint32 intSlot,
+    const QString &strPort
+    )
+{
+    //Clears a slot before its worker is (re)started
+    DtmResultEntry dreEntry;
+    memset(&dreEntry, 0, sizeof(dreEntry));
+    dreEntry.intExitCode = ResultPending;
+    dreEntry.intUpdated = QDateTime::currentMSecsSinceEpoch();
+    QByteArray baPort = strPort.toUtf8().left(ResultTablePortLength - 1);
+    memcpy(dreEntry.strPort, baPort.constData(), baPort.length());
+    Write(intSlot, dreEntry);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmResultTable::Publish(
+    quint32 intSlot,
+    quint8 intState,
+    qint32 intExitCode
+    )
+{
+    //Updates the state and result of a slot, keeping the port name
+    DtmResultEntry dreEntry;
+    if (Read(intSlot, &dreEntry) == false)
+    {
+        return;
+    }
+    dreEntry.intState = intState;
+    dreEntry.intExitCode = intExitCode;
+    dreEntry.intPID = QCoreApplication::applicationPid();
+    dreEntry.intUpdated = QDateTime::currentMSecsSinceEpoch();
+    Write(intSlot, dreEntry);
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmResultTable::Read(
+    quint32 intSlot,
+    DtmResultEntry *pEntry
+    ) const
+{
+    //Copy of the entry, never one which was half written
+    const DtmResultSlot *pSlot = Slot(intSlot);
+    if (pSlot == NULL || DtmSeqLock::Read(&pSlot->intSequence, &pSlot->dreEntry, pEntry, sizeof(DtmResultEntry), ResultTableReadRetries) == false)
+    {
+        return false;
+    }
+    pEntry->strPort[ResultTablePortLength - 1] = 0;
+    return true;
+}
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
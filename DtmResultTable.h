@@ -0,0 +1,130 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmResultTable.h
+**
+** Notes: Shared memory table of per-port state and results. Each slot has
+**        a single writer (the worker escaping that port) and is updated
+**        seqlock style so readers never block it or see a torn entry.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMRESULTTABLE_H
+#define DTMRESULTTABLE_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QString>
+#include <QSharedMemory>
+#include <atomic>
+#include "DtmSeqLock.h"
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+const quint32                  ResultTableMagic           = 0x44544d52; //"RMTD", identifies the table
+const quint32                  ResultTableVersion         = 1; //Layout version
+const quint16                  ResultTableMaxSlots        = 4096; //Largest number of ports in one table
+const quint8                   ResultTablePortLength      = 48; //Bytes stored of each port name (including the terminator)
+const qint32                   ResultPending              = 1; //Exit code of a port which has not finished
+const quint16                  ResultTableReadRetries     = 1000; //Attempts to read a consistent copy of a slot
+
+/******************************************************************************/
+// Structures
+/******************************************************************************/
+struct DtmResultEntry
+{
+    quint8 intState; //Program state of the worker
+    qint32 intExitCode; //Result, ResultPending until finished
+    qint64 intPID; //Worker process
+    qint64 intUpdated; //Time of the last update (in ms since the epoch)
+    char strPort[ResultTablePortLength]; //Port name
+};
+
+struct DtmResultSlot
+{
+    std::atomic<quint32> intSequence; //Odd whilst the entry is being written
+    DtmResultEntry dreEntry; //Current entry
+};
+
+struct DtmResultHeader
+{
+    quint32 intMagic; //ResultTableMagic
+    quint32 intVersion; //ResultTableVersion
+    quint32 intSlots; //Number of slots following the header
+};
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+class DtmResultTable
+{
+public:
+    DtmResultTable(
+        );
+    bool
+    Create(
+        const QString &strKey,
+        quint32 intSlots
+        );
+    bool
+    Attach(
+        const QString &strKey
+        );
+    bool
+    IsAttached(
+        ) const;
+    quint32
+    Slots(
+        ) const;
+    void
+    Reset(
+        quint32 intSlot,
+        const QString &strPort
+        );
+    void
+    Publish(
+        quint32 intSlot,
+        quint8 intState,
+        qint32 intExitCode
+        );
+    bool
+    Read(
+        quint32 intSlot,
+        DtmResultEntry *pEntry
+        ) const;
+
+private:
+    DtmResultSlot *
+    Slot(
+        quint32 intSlot
+        ) const;
+    void
+    Write(
+        quint32 intSlot,
+        const DtmResultEntry &dreEntry
+        );
+
+    QSharedMemory gshmTable; //Shared memory holding the header and slots
+    quint32 gintSlots; //Number of slots in the table
+};
+
+#endif // DTMRESULTTABLE_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
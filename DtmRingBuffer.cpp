@@ -0,0 +1,114 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmRingBuffer.cpp
+**
+** Notes: Fixed capacity byte ring buffer which the serial port reads into
+**        directly, so received data is never copied into a temporary
+**        QByteArray
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include "DtmRingBuffer.h"
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+DtmRingBuffer::DtmRingBuffer(
+    )
+{
+    gintReadPosition = 0;
+    gintWritePosition = 0;
+}
+
+//=============================================================================
+//=============================================================================
+qint64
+DtmRingBuffer::Fill(
+    QIODevice *pDevice
+    )
+{
+    //Reads as much as fits from the device straight into the free space, which may wrap once
+    qint64 intTotal = 0;
+    while (Used() < RingBufferCapacity)
+    {
+        quint32 intOffset = (quint32)(gintWritePosition & (RingBufferCapacity - 1));
+        qint64 intFree = RingBufferCapacity - Used();
+        qint64 intContiguous = qMin(intFree, (qint64)(RingBufferCapacity - intOffset));
+        qint64 intRead = pDevice->read(&gbaData[intOffset], intContiguous);
+        if (intRead <= 0)
+        {
+            break;
+        }
+        gintWritePosition += intRead;
+        intTotal += intRead;
+        if (intRead < intContiguous)
+        {
+            //Device is empty
+            break;
+        }
+    }
+    return intTotal;
+}
+
+//=============================================================================
+//=============================================================================
+qint64
+DtmRingBuffer::Peek(
+    const char **ppData
+    ) const
+{
+    //Returns the length of the contiguous unread data and points to it
+    quint32 intOffset = (quint32)(gintReadPosition & (RingBufferCapacity - 1));
+    *ppData = &gbaData[intOffset];
+    return qMin(Used(), (qint64)(RingBufferCapacity - intOffset));
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmRingBuffer::Consume(
+    qint64 intLength
+    )
+{
+    gintReadPosition += qMin(intLength, Used());
+}
+
+//=============================================================================
+//=============================================================================
+qint64
+DtmRingBuffer::Used(
+    ) const
+{
+    return (qint64)(gintWritePosition - gintReadPosition);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmRingBuffer::Clear(
+    )
+{
+    gintReadPosition = gintWritePosition;
+}
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
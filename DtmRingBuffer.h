@@ -0,0 +1,75 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmRingBuffer.h
+**
+** Notes: Fixed capacity byte ring buffer which the serial port reads into
+**        directly, so received data is never copied into a temporary
+**        QByteArray
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMRINGBUFFER_H
+#define DTMRINGBUFFER_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QIODevice>
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+const quint32                  RingBufferCapacity         = 4096; //Size of each ring buffer (must be a power of 2)
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+class DtmRingBuffer
+{
+public:
+    DtmRingBuffer(
+        );
+    qint64
+    Fill(
+        QIODevice *pDevice
+        );
+    qint64
+    Peek(
+        const char **ppData
+        ) const;
+    void
+    Consume(
+        qint64 intLength
+        );
+    qint64
+    Used(
+        ) const;
+    void
+    Clear(
+        );
+
+private:
+    char gbaData[RingBufferCapacity]; //Storage, allocated with the owner
+    quint64 gintReadPosition; //Total bytes consumed
+    quint64 gintWritePosition; //Total bytes stored
+};
+
+#endif // DTMRINGBUFFER_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
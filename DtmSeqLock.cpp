@@ -0,0 +1,113 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmSeqLock.cpp
+**
+** Notes: Single writer sequence lock used by the shared memory blocks. The
+**        writer never waits, readers copy the entry and retry if a write
+**        overlapped the copy.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include "DtmSeqLock.h"
+#include <string.h>
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+void
+DtmSeqLock::Write(
+    std::atomic<quint32> *pSequence,
+    void *pEntry,
+    const void *pSource,
+    quint32 intSize
+    )
+{
+    //Odd sequence, entry, even sequence. The fence keeps the entry from being written before the sequence is odd
+    quint32 intSequence = pSequence->load(std::memory_order_relaxed);
+    pSequence->store(intSequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(pEntry, pSource, intSize);
+    pSequence->store(intSequence + 2, std::memory_order_release);
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmSeqLock::Read(
+    const std::atomic<quint32> *pSequence,
+    const void *pEntry,
+    void *pDestination,
+    quint32 intSize,
+    quint16 intRetries
+    )
+{
+    //Copies the entry, retrying if a write was in progress or finished meanwhile. False if no consistent copy was made
+    quint16 intAttempt = 0;
+    while (intAttempt < intRetries)
+    {
+        quint32 intBefore = pSequence->load(std::memory_order_acquire);
+        if ((intBefore & 1) == 0)
+        {
+            memcpy(pDestination, pEntry, intSize);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (pSequence->load(std::memory_order_relaxed) == intBefore)
+            {
+                return true;
+            }
+        }
+        ++intAttempt;
+    }
+    return false;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmSeqLock::MarkReady(
+    quint32 *pMagic,
+    quint32 intMagic
+    )
+{
+    //Written last when a block is created, everything written before it is visible to a reader which sees it
+    std::atomic_thread_fence(std::memory_order_release);
+    *(volatile quint32 *)pMagic = intMagic;
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmSeqLock::IsReady(
+    const quint32 *pMagic,
+    quint32 intMagic
+    )
+{
+    //Pairs with MarkReady(), the rest of the block is only read once this is true
+    if (*(const volatile quint32 *)pMagic != intMagic)
+    {
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+}
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
@@ -0,0 +1,71 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmSeqLock.h
+**
+** Notes: Single writer sequence lock used by the shared memory blocks. The
+**        writer never waits, readers copy the entry and retry if a write
+**        overlapped the copy.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMSEQLOCK_H
+#define DTMSEQLOCK_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QtGlobal>
+#include <atomic>
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+class DtmSeqLock
+{
+public:
+    static void
+    Write(
+        std::atomic<quint32> *pSequence,
+        void *pEntry,
+        const void *pSource,
+        quint32 intSize
+        );
+    static bool
+    Read(
+        const std::atomic<quint32> *pSequence,
+        const void *pEntry,
+        void *pDestination,
+        quint32 intSize,
+        quint16 intRetries
+        );
+    static void
+    MarkReady(
+        quint32 *pMagic,
+        quint32 intMagic
+        );
+    static bool
+    IsReady(
+        const quint32 *pMagic,
+        quint32 intMagic
+        );
+};
+
+#endif // DTMSEQLOCK_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
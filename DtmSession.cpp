@@ -0,0 +1,615 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmSession.cpp
+**
+** Notes: Coroutine (C++20) interface to a module on a serial port. Each step
+**        of a session is awaited (write, CTS change, response line, delay)
+**        and resumed from the Qt event loop. All sessions share one poll
+**        timer for deadlines and modem lines.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include "DtmSession.h"
+#include "DtmMainWindow.h"
+
+/******************************************************************************/
+// Static Members
+/******************************************************************************/
+DtmTimer *DtmSession::gpPollTimer = NULL;
+DtmStopwatch DtmSession::gtmrClock;
+QList<DtmSession *> DtmSession::glstWaiting;
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+void
+DtmTask::promise_type::unhandled_exception(
+    )
+{
+    //A session which throws is reported as a serial port error (-1 would be mistaken for an invalid port)
+    intResult = ExitCodeSerialPortError;
+}
+
+//=============================================================================
+//=============================================================================
+DtmTask::DtmTask(
+    )
+{
+    ghCoroutine = nullptr;
+}
+
+//=============================================================================
+//=============================================================================
+DtmTask::DtmTask(
+    std::coroutine_handle<promise_type> hCoroutine
+    )
+{
+    ghCoroutine = hCoroutine;
+}
+
+//=============================================================================
+//=============================================================================
+DtmTask::DtmTask(
+    DtmTask &&dtOther
+    )
+{
+    ghCoroutine = dtOther.ghCoroutine;
+    dtOther.ghCoroutine = nullptr;
+}
+
+//=============================================================================
+//=============================================================================
+DtmTask &
+DtmTask::operator=(
+    DtmTask &&dtOther
+    )
+{
+    if (this != &dtOther)
+    {
+        if (ghCoroutine)
+        {
+            ghCoroutine.destroy();
+        }
+        ghCoroutine = dtOther.ghCoroutine;
+        dtOther.ghCoroutine = nullptr;
+    }
+    return *this;
+}
+
+//=============================================================================
+//=============================================================================
+DtmTask::~DtmTask(
+    )
+{
+    //Destroys the coroutine frame, abandoning it if it has not finished
+    if (ghCoroutine)
+    {
+        ghCoroutine.destroy();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmTask::Start(
+    std::function<void(int)> fnFinished
+    )
+{
+    //Runs the coroutine until its first wait
+    if (ghCoroutine && !ghCoroutine.done())
+    {
+        ghCoroutine.promise().fnFinished = fnFinished;
+        ghCoroutine.resume();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmTask::IsFinished(
+    ) const
+{
+    return (!ghCoroutine || ghCoroutine.done());
+}
+
+//=============================================================================
+//=============================================================================
+int
+DtmTask::Result(
+    ) const
+{
+    return (ghCoroutine ? ghCoroutine.promise().intResult : 0);
+}
+
+//=============================================================================
+//=============================================================================
+DtmSession::DtmSession(
+    const QString &strPort,
+    QObject *parent
+    ) : QObject(parent)
+{
+    gspSerialPort.setPortName(strPort);
+    gintWait = SessionWaitNone;
+    gbWaitResult = false;
+    gintDeadline = -1;
+    gbWaitCTS = false;
+    ghWaiting = nullptr;
+
+    if (gpPollTimer == NULL)
+    {
+        //First session, create the shared timer
+        gtmrClock.start();
+        gpPollTimer = new DtmTimer();
+        gpPollTimer->setSingleShot(true);
+        gpPollTimer->setInterval(SessionPollInterval);
+        QObject::connect(gpPollTimer, &DtmTimer::timeout, &DtmSession::PollAll);
+    }
+
+    connect(&gspSerialPort, SIGNAL(readyRead()), this, SLOT(PortReadyRead()));
+    connect(&gspSerialPort, SIGNAL(bytesWritten(qint64)), this, SLOT(PortBytesWritten(qint64)));
+    connect(&gspSerialPort, SIGNAL(error(QSerialPort::SerialPortError)), this, SLOT(PortError(QSerialPort::SerialPortError)));
+}
+
+//=============================================================================
+//=============================================================================
+DtmSession::~DtmSession(
+    )
+{
+    glstWaiting.removeAll(this);
+    if (glstWaiting.isEmpty() && gpPollTimer != NULL)
+    {
+        gpPollTimer->stop();
+    }
+    Close();
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmSession::Open(
+    qint32 intBaud,
+    QSerialPort::FlowControl spfFlow
+    )
+{
+    //(Re)opens the port at the given settings
+    Close();
+    gspSerialPort.setBaudRate(intBaud);
+    gspSerialPort.setDataBits(QSerialPort::Data8);
+    gspSerialPort.setStopBits(QSerialPort::OneStop);
+    gspSerialPort.setParity(QSerialPort::NoParity);
+    gspSerialPort.setFlowControl(spfFlow);
+    gbaLineBuffer.clear();
+    return gspSerialPort.open(QIODevice::ReadWrite);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmSession::Close(
+    )
+{
+    if (gspSerialPort.isOpen() == true)
+    {
+        gspSerialPort.clear();
+        gspSerialPort.close();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmSession::CTS(
+    )
+{
+    return ((gspSerialPort.pinoutSignals() & QSerialPort::ClearToSendSignal) == QSerialPort::ClearToSendSignal);
+}
+
+//=============================================================================
+//=============================================================================
+QString
+DtmSession::LastLine(
+    ) const
+{
+    return gstrLastLine;
+}
+
+//=============================================================================
+//=============================================================================
+QString
+DtmSession::ErrorString(
+    ) const
+{
+    return gspSerialPort.errorString();
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmSession::Wait(
+    quint8 intWait,
+    qint64 intTimeout
+    )
+{
+    //Starts a wait, polled by the shared timer if it has a deadline or needs the modem lines
+    gintWait = intWait;
+    gbWaitResult = false;
+    gintDeadline = (intTimeout < 0 ? -1 : gtmrClock.elapsed() + intTimeout);
+    if (gintDeadline >= 0 || intWait == SessionWaitCTS)
+    {
+        if (glstWaiting.contains(this) == false)
+        {
+            glstWaiting.append(this);
+        }
+        if (gpPollTimer->isActive() == false)
+        {
+            gpPollTimer->start();
+        }
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmSession::Finish(
+    bool bResult
+    )
+{
+    //Ends the current wait and resumes the coroutine waiting on it
+    glstWaiting.removeAll(this);
+    if (glstWaiting.isEmpty())
+    {
+        gpPollTimer->stop();
+    }
+    gbWaitResult = bResult;
+    gintWait = SessionWaitNone;
+    if (ghWaiting)
+    {
+        std::coroutine_handle<> hWaiting = ghWaiting;
+        ghWaiting = nullptr;
+        hWaiting.resume();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+DtmSession::Awaiter
+DtmSession::Write(
+    const QByteArray &baData
+    )
+{
+    //Completes once the data has left the port buffer
+    Wait(SessionWaitWrite, ModuleTimeout);
+    if (gspSerialPort.write(baData) != baData.length())
+    {
+        //Write failed
+        glstWaiting.removeAll(this);
+        gintWait = SessionWaitNone;
+    }
+    return Awaiter{this};
+}
+
+//=============================================================================
+//=============================================================================
+DtmSession::Awaiter
+DtmSession::WaitForCTS(
+    bool bAsserted,
+    qint64 intTimeout
+    )
+{
+    //Completes with true once CTS is in the given state, false at the deadline
+    gbWaitCTS = bAsserted;
+    if (CTS() == bAsserted)
+    {
+        gbWaitResult = true;
+        gintWait = SessionWaitNone;
+    }
+    else
+    {
+        Wait(SessionWaitCTS, intTimeout);
+    }
+    return Awaiter{this};
+}
+
+//=============================================================================
+//=============================================================================
+DtmSession::Awaiter
+DtmSession::ExpectLine(
+    const QRegularExpression &reLine,
+    qint64 intTimeout
+    )
+{
+    //Completes with true once a received line matches, false at the deadline
+    greWaitLine = reLine;
+    Wait(SessionWaitLine, intTimeout);
+    if (MatchLine() == true)
+    {
+        glstWaiting.removeAll(this);
+        gbWaitResult = true;
+        gintWait = SessionWaitNone;
+    }
+    return Awaiter{this};
+}
+
+//=============================================================================
+//=============================================================================
+DtmSession::Awaiter
+DtmSession::Delay(
+    qint64 intTime
+    )
+{
+    //Completes with true after the given time
+    Wait(SessionWaitDelay, intTime);
+    return Awaiter{this};
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmSession::MatchLine(
+    )
+{
+    //Consumes received lines up to and including the first which matches the pattern
+    qint32 intStart = 0;
+    qint32 intEnd = gbaLineBuffer.indexOf('\n');
+    while (intEnd != -1)
+    {
+        QString strLine = QString(gbaLineBuffer.mid(intStart, intEnd - intStart)).remove('\r');
+        if (greWaitLine.match(strLine).hasMatch())
+        {
+            gstrLastLine = strLine;
+            gbaLineBuffer.remove(0, intEnd + 1);
+            return true;
+        }
+        intStart = intEnd + 1;
+        intEnd = gbaLineBuffer.indexOf('\n', intStart);
+    }
+    gbaLineBuffer.remove(0, intStart);
+    return false;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmSession::PortReadyRead(
+    )
+{
+    gbaLineBuffer.append(gspSerialPort.readAll());
+    if (gintWait == SessionWaitLine && MatchLine() == true)
+    {
+        Finish(true);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmSession::PortBytesWritten(
+    qint64
+    )
+{
+    if (gintWait == SessionWaitWrite && gspSerialPort.bytesToWrite() == 0)
+    {
+        Finish(true);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmSession::PortError(
+    QSerialPort::SerialPortError speErrorCode
+    )
+{
+    //Fails the current wait if the device went away
+    if ((speErrorCode == QSerialPort::ResourceError || speErrorCode == QSerialPort::PermissionError) && gintWait != SessionWaitNone)
+    {
+        Close();
+        Finish(false);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmSession::PollAll(
+    )
+{
+    //Shared timer tick, sessions may finish (and leave the list) whilst being polled
+    QList<DtmSession *> lstWaiting = glstWaiting;
+    int i = 0;
+    while (i < lstWaiting.length())
+    {
+        if (glstWaiting.contains(lstWaiting[i]))
+        {
+            lstWaiting[i]->Poll();
+        }
+        ++i;
+    }
+
+    if (glstWaiting.isEmpty() == false && gpPollTimer->isActive() == false)
+    {
+        //Single shot so that a virtual clock keeps moving towards the deadlines
+        gpPollTimer->start();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmSession::Poll(
+    )
+{
+    if (gintWait == SessionWaitCTS && gspSerialPort.isOpen() == true && CTS() == gbWaitCTS)
+    {
+        Finish(true);
+    }
+    else if (gintDeadline >= 0 && gtmrClock.elapsed() >= gintDeadline)
+    {
+        //Delays succeed at their deadline, everything else has timed out
+        Finish(gintWait == SessionWaitDelay);
+    }
+}
+
+//=============================================================================
+//=============================================================================
+DtmTask
+DtmSession::Escape(
+    qint32 intUserBaud,
+    QSerialPort::FlowControl spfUserFlow,
+    quint8 intRetries,
+    bool bLicenseCheck,
+    QStringList slAllowedFirmware,
+    QStringList slAllowedTypes
+    )
+{
+    //Escapes the module from DTM, erases the filesystem and optionally checks the license, returning the exit code. The
+    //allow-lists are taken by value as the coroutine outlives the caller's copies
+    if (Open(DTMBaudRate, DTMFlowControl) == false)
+    {
+        co_return ExitCodeInvalidPort;
+    }
+
+#ifndef TARGET_OS_MAC
+    if (CTS() == true)
+    {
+        //CTS should not be asserted in DTM mode
+        Close();
+        co_return ExitCodeCTSAsserted;
+    }
+#endif
+
+    //Send the exit command, resending with exponential backoff
+    quint16 intInterval = DTMRetryInitialInterval;
+    quint8 intAttempt = 0;
+    while (true)
+    {
+        QByteArray baExitDTM;
+        baExitDTM.append(DTMExitCMDA);
+        baExitDTM.append(DTMExitCMDB);
+        if (co_await Write(baExitDTM) == false)
+        {
+            Close();
+            co_return ExitCodeSerialPortError;
+        }
+
+#ifdef TARGET_OS_MAC
+        //No usable CTS on mac, assume the module has reset
+        co_await Delay(350);
+        break;
+#else
+        if (co_await WaitForCTS(true, (intAttempt < intRetries ? intInterval : ModuleTimeout)) == true)
+        {
+            break;
+        }
+        if (gspSerialPort.isOpen() == false)
+        {
+            co_return ExitCodeSerialPortError;
+        }
+        if (intAttempt >= intRetries)
+        {
+            Close();
+            co_return ExitCodeTimeout;
+        }
+        ++intAttempt;
+        intInterval = qMin((quint16)(intInterval*2), DTMRetryMaxInterval);
+#endif
+    }
+
+    //Erase the filesystem at the interactive settings
+    if (Open(intUserBaud, spfUserFlow) == false)
+    {
+        co_return ExitCodeSerialPortError;
+    }
+
+    if (slAllowedFirmware.count() > 0 || slAllowedTypes.count() > 0)
+    {
+        //Check the module before anything is erased, one query at a time so a missing response cannot consume the next
+        QString strFirmware;
+        QString strType;
+        bool bFirmwareFound = false;
+        bool bTypeFound = false;
+        if (co_await Write(QByteArray("\r").append(IdentifyFirmwareQuery).append("\r")) == false)
+        {
+            Close();
+            co_return ExitCodeSerialPortError;
+        }
+        if (co_await ExpectLine(QRegularExpression("^10\t3\t"), IdentifyProbeTimeout) == true)
+        {
+            bFirmwareFound = true;
+            strFirmware = LastLine().mid(5).trimmed();
+        }
+        if (co_await Write(QByteArray(IdentifyTypeQuery).append("\r")) == false)
+        {
+            Close();
+            co_return ExitCodeSerialPortError;
+        }
+        if (co_await ExpectLine(QRegularExpression("^10\t0\t"), IdentifyProbeTimeout) == true)
+        {
+            bTypeFound = true;
+            strType = LastLine().mid(5).trimmed();
+        }
+
+        //A missing response only passes if that value is not being checked
+        if ((slAllowedFirmware.count() > 0 && (bFirmwareFound == false || MainWindow::IdentityAllowed(slAllowedFirmware, strFirmware) == false)) || (slAllowedTypes.count() > 0 && (bTypeFound == false || MainWindow::IdentityAllowed(slAllowedTypes, strType) == false)))
+        {
+            Close();
+            co_return ExitCodeIdentityMismatch;
+        }
+    }
+
+    if (co_await Write("\rat&f*\r") == false)
+    {
+        Close();
+        co_return ExitCodeSerialPortError;
+    }
+    if (co_await ExpectLine(QRegularExpression("^FFS Erased, Rebooting\\.\\.\\."), ModuleTimeout) == false || co_await ExpectLine(QRegularExpression("^00$"), ModuleTimeout) == false)
+    {
+        Close();
+        co_return ExitCodeTimeout;
+    }
+
+    int intResult = ExitCodeOK;
+    if (bLicenseCheck == true)
+    {
+        //Placeholder address means the module has no license
+        if (co_await Write("at i 4\r") == false)
+        {
+            Close();
+            co_return ExitCodeSerialPortError;
+        }
+        if (co_await ExpectLine(QRegularExpression("^10\t4\t00 [a-zA-Z0-9]{12}$"), ModuleTimeout) == false)
+        {
+            Close();
+            co_return ExitCodeTimeout;
+        }
+        if (LastLine().right(12).toUpper() == LicensePlaceholder)
+        {
+            intResult = ExitCodeLicenseMissing;
+        }
+    }
+
+    Close();
+    co_return intResult;
+}
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
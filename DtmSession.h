@@ -0,0 +1,237 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmSession.h
+**
+** Notes: Coroutine (C++20) interface to a module on a serial port. Each step
+**        of a session is awaited (write, CTS change, response line, delay)
+**        and resumed from the Qt event loop. All sessions share one poll
+**        timer for deadlines and modem lines.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMSESSION_H
+#define DTMSESSION_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QObject>
+#include <QSerialPort>
+#include <QRegularExpression>
+#include <QList>
+#include <QStringList>
+#include <coroutine>
+#include <functional>
+#include "DtmClock.h"
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+const quint8                   SessionWaitNone            = 0;
+const quint8                   SessionWaitWrite           = 1; //Waiting for all data to be written
+const quint8                   SessionWaitCTS             = 2; //Waiting for CTS to reach a state
+const quint8                   SessionWaitLine            = 3; //Waiting for a line matching a pattern
+const quint8                   SessionWaitDelay           = 4; //Waiting for time to pass
+const quint16                  SessionPollInterval        = 10; //Time (in ms) between deadline and modem line checks, shared by all sessions
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+class DtmTask
+{
+public:
+    struct promise_type
+    {
+        int intResult = 0; //Value passed to co_return
+        std::function<void(int)> fnFinished; //Called once the coroutine has finished
+
+        struct FinalAwaiter
+        {
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<promise_type> hCoroutine) noexcept
+            {
+                //Coroutine is suspended, the callback may destroy the task
+                if (hCoroutine.promise().fnFinished)
+                {
+                    std::function<void(int)> fnFinished = hCoroutine.promise().fnFinished;
+                    fnFinished(hCoroutine.promise().intResult);
+                }
+            }
+            void await_resume() const noexcept {}
+        };
+
+        DtmTask get_return_object() { return DtmTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_value(int intValue) { intResult = intValue; }
+        void unhandled_exception();
+    };
+
+    DtmTask(
+        );
+    explicit DtmTask(
+        std::coroutine_handle<promise_type> hCoroutine
+        );
+    DtmTask(
+        DtmTask &&dtOther
+        );
+    DtmTask &
+    operator=(
+        DtmTask &&dtOther
+        );
+    ~DtmTask(
+        );
+    void
+    Start(
+        std::function<void(int)> fnFinished
+        );
+    bool
+    IsFinished(
+        ) const;
+    int
+    Result(
+        ) const;
+
+private:
+    DtmTask(
+        const DtmTask &
+        ) = delete;
+    DtmTask &
+    operator=(
+        const DtmTask &
+        ) = delete;
+
+    std::coroutine_handle<promise_type> ghCoroutine; //Coroutine frame owned by this task
+};
+
+class DtmSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Awaiter
+    {
+        DtmSession *pSession;
+        bool await_ready() const noexcept { return pSession->gintWait == SessionWaitNone; }
+        void await_suspend(std::coroutine_handle<> hCoroutine) { pSession->ghWaiting = hCoroutine; }
+        bool await_resume() { pSession->gintWait = SessionWaitNone; return pSession->gbWaitResult; }
+    };
+
+    explicit DtmSession(
+        const QString &strPort,
+        QObject *parent = 0
+        );
+    ~DtmSession(
+        );
+    bool
+    Open(
+        qint32 intBaud,
+        QSerialPort::FlowControl spfFlow
+        );
+    void
+    Close(
+        );
+    bool
+    CTS(
+        );
+    QString
+    LastLine(
+        ) const;
+    QString
+    ErrorString(
+        ) const;
+    Awaiter
+    Write(
+        const QByteArray &baData
+        );
+    Awaiter
+    WaitForCTS(
+        bool bAsserted,
+        qint64 intTimeout
+        );
+    Awaiter
+    ExpectLine(
+        const QRegularExpression &reLine,
+        qint64 intTimeout
+        );
+    Awaiter
+    Delay(
+        qint64 intTime
+        );
+    DtmTask
+    Escape(
+        qint32 intUserBaud,
+        QSerialPort::FlowControl spfUserFlow,
+        quint8 intRetries,
+        bool bLicenseCheck,
+        QStringList slAllowedFirmware,
+        QStringList slAllowedTypes
+        );
+
+private slots:
+    void
+    PortReadyRead(
+        );
+    void
+    PortBytesWritten(
+        qint64 intByteCount
+        );
+    void
+    PortError(
+        QSerialPort::SerialPortError speErrorCode
+        );
+
+private:
+    static void
+    PollAll(
+        );
+    void
+    Poll(
+        );
+    void
+    Wait(
+        quint8 intWait,
+        qint64 intTimeout
+        );
+    void
+    Finish(
+        bool bResult
+        );
+    bool
+    MatchLine(
+        );
+
+    QSerialPort gspSerialPort; //Port the module is connected to
+    quint8 gintWait; //What the session is currently waiting for
+    bool gbWaitResult; //Result returned from the current wait
+    qint64 gintDeadline; //Time (from the shared clock, in ms) the current wait fails at, negative for none
+    bool gbWaitCTS; //CTS state being waited for
+    QRegularExpression greWaitLine; //Pattern being waited for
+    QByteArray gbaLineBuffer; //Received data not yet consumed by a line match
+    QString gstrLastLine; //Line which matched the last pattern
+    std::coroutine_handle<> ghWaiting; //Coroutine to resume when the wait finishes
+
+    static DtmTimer *gpPollTimer; //Timer shared by all sessions to check deadlines and modem lines, re-armed after every tick
+    static DtmStopwatch gtmrClock; //Clock shared by all sessions
+    static QList<DtmSession *> glstWaiting; //Sessions with a wait that needs polling
+};
+
+#endif // DTMSESSION_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
@@ -0,0 +1,243 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmStatusBlock.cpp
+**
+** Notes: Live status block of this port in named shared memory (POSIX shm
+**        or a Windows file mapping) for dashboards. The block has a fixed,
+**        versioned layout and is updated seqlock style so readers never
+**        block the serial path or see a torn entry.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include "DtmStatusBlock.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+DtmStatusBlock::DtmStatusBlock(
+    )
+{
+    gpSegment = NULL;
+#ifdef _WIN32
+    gpMapping = NULL;
+#endif
+    memset(&gdseEntry, 0, sizeof(gdseEntry));
+    gdseEntry.intLastResult = StatusResultNone;
+}
+
+//=============================================================================
+//=============================================================================
+DtmStatusBlock::~DtmStatusBlock(
+    )
+{
+    Close();
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmStatusBlock::Create(
+    const QString &strName,
+    const QString &strPort
+    )
+{
+    //Creates the segment, failing if the name is already in use so that another instance's block is never
+    //taken over (or later removed). Readers open it by name: shm_open("/<name>") or OpenFileMapping("Local\\<name>") on windows
+    Close();
+    gstrName = strName;
+    gstrError.clear();
+#ifdef _WIN32
+    gpMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(DtmStatusSegment), (const wchar_t *)QString("Local\\").append(strName).utf16());
+    if (gpMapping != NULL && GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        //Opened the block of another instance
+        CloseHandle(gpMapping);
+        gpMapping = NULL;
+        gstrError = QString("the name ").append(strName).append(" is already in use by another process");
+        return false;
+    }
+    if (gpMapping == NULL)
+    {
+        gstrError = QString("error ").append(QString::number(GetLastError()));
+        return false;
+    }
+    gpSegment = (DtmStatusSegment *)MapViewOfFile(gpMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(DtmStatusSegment));
+    if (gpSegment == NULL)
+    {
+        CloseHandle(gpMapping);
+        gpMapping = NULL;
+        return false;
+    }
+#else
+    QByteArray baName = QString("/").append(strName).toUtf8();
+    int intHandle = shm_open(baName.constData(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (intHandle < 0)
+    {
+        gstrError = (errno == EEXIST ? QString("the name ").append(strName).append(" is already in use by another process, or was left in /dev/shm by one which did not exit cleanly") : QString(strerror(errno)));
+        return false;
+    }
+    if (ftruncate(intHandle, sizeof(DtmStatusSegment)) != 0)
+    {
+        //Created above, so it is this process's to remove
+        gstrError = QString(strerror(errno));
+        close(intHandle);
+        shm_unlink(baName.constData());
+        return false;
+    }
+    void *pMapped = mmap(NULL, sizeof(DtmStatusSegment), PROT_READ | PROT_WRITE, MAP_SHARED, intHandle, 0);
+    close(intHandle);
+    if (pMapped == MAP_FAILED)
+    {
+        gstrError = QString("unable to map the segment");
+        shm_unlink(baName.constData());
+        return false;
+    }
+    gpSegment = (DtmStatusSegment *)pMapped;
+#endif
+
+    //Readers ignore the block until the magic is written
+    memset((void *)gpSegment, 0, sizeof(DtmStatusSegment));
+    gpSegment->intVersion = StatusBlockVersion;
+    gpSegment->intSize = sizeof(DtmStatusSegment);
+    gdseEntry.intPID = QCoreApplication::applicationPid();
+    gdseEntry.intUpdated = QDateTime::currentMSecsSinceEpoch();
+    QByteArray baPort = strPort.toUtf8().left(StatusBlockPortLength - 1);
+    memset(gdseEntry.strPort, 0, StatusBlockPortLength);
+    memcpy(gdseEntry.strPort, baPort.constData(), baPort.length());
+    Publish();
+    DtmSeqLock::MarkReady(&gpSegment->intMagic, StatusBlockMagic);
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmStatusBlock::Close(
+    )
+{
+    //Unmaps and removes the segment, readers see it disappear. Only set once this process has created it
+    if (gpSegment == NULL)
+    {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(gpSegment);
+    CloseHandle(gpMapping);
+    gpMapping = NULL;
+#else
+    munmap(gpSegment, sizeof(DtmStatusSegment));
+    shm_unlink(QString("/").append(gstrName).toUtf8().constData());
+#endif
+    gpSegment = NULL;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmStatusBlock::Publish(
+    )
+{
+    //This process is the only writer
+    DtmSeqLock::Write(&gpSegment->intSequence, &gpSegment->dseEntry, &gdseEntry, sizeof(DtmStatusEntry));
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmStatusBlock::SetState(
+    quint8 intState
+    )
+{
+    if (gpSegment == NULL)
+    {
+        return;
+    }
+    gdseEntry.intState = intState;
+    gdseEntry.intStageStart = QDateTime::currentMSecsSinceEpoch();
+    gdseEntry.intUpdated = gdseEntry.intStageStart;
+    Publish();
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmStatusBlock::SetBytes(
+    quint64 intRXBytes,
+    quint64 intTXBytes
+    )
+{
+    //Called from the serial path, so only the counters are touched
+    if (gpSegment == NULL)
+    {
+        return;
+    }
+    gdseEntry.intRXBytes = intRXBytes;
+    gdseEntry.intTXBytes = intTXBytes;
+    Publish();
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmStatusBlock::SetResult(
+    qint32 intExitCode
+    )
+{
+    if (gpSegment == NULL)
+    {
+        return;
+    }
+    gdseEntry.intLastResult = intExitCode;
+    gdseEntry.intUpdated = QDateTime::currentMSecsSinceEpoch();
+    Publish();
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmStatusBlock::SetLicense(
+    quint8 intLicense
+    )
+{
+    if (gpSegment == NULL)
+    {
+        return;
+    }
+    gdseEntry.intLicense = intLicense;
+    gdseEntry.intUpdated = QDateTime::currentMSecsSinceEpoch();
+    Publish();
+}
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
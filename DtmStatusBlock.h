@@ -0,0 +1,140 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmStatusBlock.h
+**
+** Notes: Live status block of this port in named shared memory (POSIX shm
+**        or a Windows file mapping) for dashboards. The block has a fixed,
+**        versioned layout and is updated seqlock style so readers never
+**        block the serial path or see a torn entry.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMSTATUSBLOCK_H
+#define DTMSTATUSBLOCK_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QString>
+#include <atomic>
+#include "DtmSeqLock.h"
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+const quint32                  StatusBlockMagic           = 0x44544d53; //"SMTD", identifies the block
+const quint32                  StatusBlockVersion         = 1; //Layout version
+const quint8                   StatusBlockPortLength      = 48; //Bytes stored of the port name (including the terminator)
+const quint8                   StatusLicenseUnknown       = 0; //License not checked yet
+const quint8                   StatusLicenseValid         = 1; //Module has a valid license
+const quint8                   StatusLicenseMissing       = 2; //Module has the placeholder license
+const quint8                   StatusLicenseInstalled     = 3; //License installed from the key file and verified
+const qint32                   StatusResultNone           = 1; //Last result of a port which has not finished a module
+
+/******************************************************************************/
+// Structures
+/******************************************************************************/
+struct DtmStatusEntry
+{
+    qint64 intPID; //Process publishing the block
+    qint64 intStageStart; //Time the current program state was entered (in ms since the epoch)
+    qint64 intUpdated; //Time of the last state, result or license change (in ms since the epoch)
+    quint64 intRXBytes; //Bytes received since the process started
+    quint64 intTXBytes; //Bytes sent since the process started
+    qint32 intLastResult; //Exit code of the last module, StatusResultNone until one finishes
+    quint8 intState; //Current program state
+    quint8 intLicense; //License state of the current (or last) module
+    quint8 intReserved[2]; //Padding, zero
+    char strPort[StatusBlockPortLength]; //Port name
+};
+
+struct DtmStatusSegment
+{
+    quint32 intMagic; //StatusBlockMagic, written last when creating
+    quint32 intVersion; //StatusBlockVersion
+    quint32 intSize; //Size of this structure
+    std::atomic<quint32> intSequence; //Odd whilst the entry is being written
+    DtmStatusEntry dseEntry; //Current entry
+};
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+class DtmStatusBlock
+{
+public:
+    DtmStatusBlock(
+        );
+    ~DtmStatusBlock(
+        );
+    bool
+    Create(
+        const QString &strName,
+        const QString &strPort
+        );
+    inline bool
+    IsOpen(
+        ) const
+    {
+        return (gpSegment != NULL);
+    }
+    inline QString
+    ErrorString(
+        ) const
+    {
+        return gstrError;
+    }
+    void
+    SetState(
+        quint8 intState
+        );
+    void
+    SetBytes(
+        quint64 intRXBytes,
+        quint64 intTXBytes
+        );
+    void
+    SetResult(
+        qint32 intExitCode
+        );
+    void
+    SetLicense(
+        quint8 intLicense
+        );
+
+private:
+    void
+    Publish(
+        );
+    void
+    Close(
+        );
+
+    DtmStatusSegment *gpSegment; //Mapped segment (NULL if not publishing)
+    DtmStatusEntry gdseEntry; //Local copy of the entry, copied into the segment on every change
+    QString gstrName; //Name the segment was created with
+    QString gstrError; //Reason the last Create() failed
+#ifdef _WIN32
+    void *gpMapping; //Handle of the file mapping
+#endif
+};
+
+#endif // DTMSTATUSBLOCK_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
@@ -0,0 +1,437 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmSupervisor.cpp
+**
+** Notes: Runs the escapes of many ports in worker processes pinned to
+**        cores, follows them through the shared result table and restarts
+**        workers which crash.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include "DtmSupervisor.h"
+#include "DtmConstants.h"
+#include "DtmPortHealth.h"
+#include "DtmEvents.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QThread>
+#include <QTextStream>
+#ifdef _WIN32
+#include <windows.h>
+#elif !defined(__APPLE__)
+#include <sched.h>
+#endif
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+DtmSupervisor::DtmSupervisor(
+    QObject *parent
+    ) : QObject(parent)
+{
+    gintNextSlot = 0;
+    gintRunning = 0;
+    gintMaxWorkers = 1;
+    gintCores = 1;
+    gbQuarantine = false;
+    gpText = stdout;
+    gpSettings = new QSettings(QSettings::IniFormat, QSettings::UserScope, "Laird", "ExitDTM");
+    gpReportTimer = new QTimer(this);
+    gpReportTimer->setInterval(SupervisorReportInterval);
+    connect(gpReportTimer, SIGNAL(timeout()), this, SLOT(Report()));
+}
+
+//=============================================================================
+//=============================================================================
+DtmSupervisor::~DtmSupervisor(
+    )
+{
+    //Stop any workers still running
+    int i = 0;
+    while (i < glstWorkers.count())
+    {
+        if (glstWorkers[i] != NULL)
+        {
+            disconnect(glstWorkers[i], 0, this, 0);
+            glstWorkers[i]->kill();
+            glstWorkers[i]->waitForFinished(1000);
+            delete glstWorkers[i];
+        }
+        ++i;
+    }
+    delete gpReportTimer;
+    delete gpSettings;
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmSupervisor::IsRequested(
+    const QStringList &slArgs
+    )
+{
+    //True if the command line asks for a supervisor
+    int i = 1;
+    while (i < slArgs.length())
+    {
+        if (slArgs[i].left(10).toUpper() == "SUPERVISE=")
+        {
+            return true;
+        }
+        ++i;
+    }
+    return false;
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmSupervisor::PinToCore(
+    int intCore
+    )
+{
+    //Restricts the calling process to a single core
+    if (intCore < 0)
+    {
+        return false;
+    }
+#ifdef _WIN32
+    return (SetProcessAffinityMask(GetCurrentProcess(), ((DWORD_PTR)1) << (intCore % (sizeof(DWORD_PTR)*8))) != 0);
+#elif defined(__APPLE__)
+    //No affinity control on mac, the scheduler decides
+    return false;
+#else
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(intCore % CPU_SETSIZE, &cpuSet);
+    return (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) == 0);
+#endif
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmSupervisor::Start(
+    const QStringList &slArgs
+    )
+{
+    //Splits the ports over the workers. SUPERVISE= takes a comma separated list of ports or @file
+    //with one port per line, WORKERS= limits how many run at once (default one per port, up to SupervisorDefaultWorkers)
+    gintCores = qMax(QThread::idealThreadCount(), 1);
+    gintMaxWorkers = 0;
+    int i = 1;
+    while (i < slArgs.length())
+    {
+        if (slArgs[i].left(10).toUpper() == "SUPERVISE=")
+        {
+            QString strPorts = slArgs[i].right(slArgs[i].length()-10);
+            if (strPorts.left(1) == "@")
+            {
+                //Ports listed in a file
+                QFile fileList(strPorts.right(strPorts.length()-1));
+                if (fileList.open(QIODevice::ReadOnly) == true)
+                {
+                    strPorts = QString(fileList.readAll()).replace("\r", "").replace("\n", ",");
+                }
+            }
+            QStringList slTempPorts = strPorts.split(',');
+            int j = 0;
+            while (j < slTempPorts.length())
+            {
+                if (slTempPorts[j].trimmed().length() > 0)
+                {
+                    gslPorts.append(slTempPorts[j].trimmed());
+                }
+                ++j;
+            }
+        }
+        else if (slArgs[i].left(8).toUpper() == "WORKERS=")
+        {
+            gintMaxWorkers = qMax(slArgs[i].right(slArgs[i].length()-8).toInt(), 1);
+        }
+        else if (slArgs[i].toUpper() == "QUARANTINE")
+        {
+            //Skip quarantined ports here, the workers are also told so they can quarantine ports
+            gbQuarantine = true;
+            gslWorkerArgs.append(slArgs[i]);
+        }
+        else if (slArgs[i].toUpper() == "EVENTS")
+        {
+            //Workers share stdout for their event streams, so progress text moves to stderr
+            gpText = stderr;
+            DtmEvent::Enable("");
+            gslWorkerArgs.append(slArgs[i]);
+        }
+        else if (slArgs[i].left(4).toUpper() != "COM=" && slArgs[i].toUpper() != "AUTOEXIT" && slArgs[i].toUpper() != "NOWINDOW" && slArgs[i].left(11).toUpper() != "RESULTSLOT=" && slArgs[i].left(4).toUpper() != "CPU=")
+        {
+            //Passed on to the workers, %PORT% is replaced so each worker can have its own files
+            gslWorkerArgs.append(slArgs[i]);
+        }
+        ++i;
+    }
+
+    QTextStream tsOut(gpText);
+    if (gslPorts.count() == 0)
+    {
+        tsOut << "No ports given to supervise\n";
+        return false;
+    }
+
+    if (gintMaxWorkers == 0)
+    {
+        //Workers spend nearly all of their time waiting on the modules, so the core count is no limit
+        gintMaxWorkers = qMin(gslPorts.count(), SupervisorDefaultWorkers);
+    }
+
+    if (grtTable.Create(QString("ExitDTM-").append(QString::number(QCoreApplication::applicationPid())), gslPorts.count()) == false)
+    {
+        tsOut << "Unable to create the shared result table\n";
+        return false;
+    }
+
+    i = 0;
+    while (i < gslPorts.count())
+    {
+        glstWorkers.append(NULL);
+        glstRestarts.append(0);
+        glstResults.append(ResultPending);
+        ++i;
+    }
+
+    tsOut << "Supervising " << gslPorts.count() << " ports with up to " << gintMaxWorkers << " workers on " << gintCores << " cores\n";
+    tsOut.flush();
+    gpReportTimer->start();
+    StartPending();
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmSupervisor::StartWorker(
+    int intSlot
+    )
+{
+    //Launches a worker for one port, COM= and AUTOEXIT come before NOWINDOW as it depends on them
+    grtTable.Reset(intSlot, gslPorts[intSlot]);
+    QString strPortTag = QString(gslPorts[intSlot]).replace("/", "_").replace("\\", "_").replace(":", "_");
+    QStringList slArgs;
+    slArgs << QString("COM=").append(gslPorts[intSlot]) << "AUTOEXIT";
+    int i = 0;
+    while (i < gslWorkerArgs.count())
+    {
+        slArgs << QString(gslWorkerArgs[i]).replace("%PORT%", strPortTag);
+        ++i;
+    }
+    slArgs << QString("RESULTSLOT=ExitDTM-").append(QString::number(QCoreApplication::applicationPid())).append(",").append(QString::number(intSlot));
+    slArgs << QString("CPU=").append(QString::number(intSlot % gintCores));
+    slArgs << "NOWINDOW";
+
+    QProcess *pWorker = new QProcess(this);
+    pWorker->setProcessChannelMode(QProcess::ForwardedChannels);
+    pWorker->setProperty("slot", intSlot);
+    connect(pWorker, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(WorkerFinished(int,QProcess::ExitStatus)));
+    connect(pWorker, SIGNAL(errorOccurred(QProcess::ProcessError)), this, SLOT(WorkerError(QProcess::ProcessError)));
+    glstWorkers[intSlot] = pWorker;
+    ++gintRunning;
+    pWorker->start(QCoreApplication::applicationFilePath(), slArgs);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmSupervisor::StartPending(
+    )
+{
+    //Starts workers until the limit is reached or every port has been started
+    while (gintRunning < gintMaxWorkers && gintNextSlot < gslPorts.count())
+    {
+        if (gbQuarantine == true && DtmPortHealth::IsQuarantined(gpSettings, gslPorts[gintNextSlot]) == true)
+        {
+            //Port is out of service until its history is reset
+            QTextStream(gpText) << "Skipping quarantined port " << gslPorts[gintNextSlot] << "\n";
+            glstResults[gintNextSlot] = ExitCodeQuarantined;
+            DtmEvent("result", gslPorts[gintNextSlot]).Add("code", (qint64)ExitCodeQuarantined).Add("result", DtmMetrics::ResultName(ExitCodeQuarantined)).Emit();
+            grtTable.Reset(gintNextSlot, gslPorts[gintNextSlot]);
+            grtTable.Publish(gintNextSlot, 0, ExitCodeQuarantined);
+        }
+        else
+        {
+            StartWorker(gintNextSlot);
+        }
+        ++gintNextSlot;
+    }
+
+    if (gintRunning == 0 && gintNextSlot >= gslPorts.count())
+    {
+        Finish();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmSupervisor::WorkerFinished(
+    int intExitCode,
+    QProcess::ExitStatus pesStatus
+    )
+{
+    //A worker has exited, only its own port is retried if it crashed
+    QProcess *pWorker = qobject_cast<QProcess *>(sender());
+    if (pWorker == NULL)
+    {
+        return;
+    }
+    int intSlot = pWorker->property("slot").toInt();
+    glstWorkers[intSlot] = NULL;
+    --gintRunning;
+    pWorker->deleteLater();
+
+    DtmResultEntry dreEntry;
+    bool bPublished = (grtTable.Read(intSlot, &dreEntry) == true && dreEntry.intExitCode != ResultPending);
+    if (pesStatus == QProcess::CrashExit || bPublished == false)
+    {
+        //Crashed (or exited without a result)
+        if (glstRestarts[intSlot] < SupervisorMaxRestarts)
+        {
+            ++glstRestarts[intSlot];
+            QTextStream(gpText) << "Worker for " << gslPorts[intSlot] << " crashed (exit " << intExitCode << "), restarting\n";
+            StartWorker(intSlot);
+            return;
+        }
+        glstResults[intSlot] = ExitCodeWorkerCrashed;
+        DtmEvent("result", gslPorts[intSlot]).Add("code", (qint64)ExitCodeWorkerCrashed).Add("result", DtmMetrics::ResultName(ExitCodeWorkerCrashed)).Emit();
+    }
+    else
+    {
+        glstResults[intSlot] = dreEntry.intExitCode;
+    }
+    StartPending();
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmSupervisor::WorkerError(
+    QProcess::ProcessError peeError
+    )
+{
+    //A worker which could not be started never finishes, so fail its port here
+    QProcess *pWorker = qobject_cast<QProcess *>(sender());
+    if (pWorker == NULL || peeError != QProcess::FailedToStart)
+    {
+        return;
+    }
+    int intSlot = pWorker->property("slot").toInt();
+    glstWorkers[intSlot] = NULL;
+    --gintRunning;
+    pWorker->deleteLater();
+    QTextStream(gpText) << "Unable to start worker for " << gslPorts[intSlot] << "\n";
+    glstResults[intSlot] = ExitCodeWorkerCrashed;
+    DtmEvent("result", gslPorts[intSlot]).Add("code", (qint64)ExitCodeWorkerCrashed).Add("result", DtmMetrics::ResultName(ExitCodeWorkerCrashed)).Emit();
+    StartPending();
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmSupervisor::Report(
+    )
+{
+    //Prints a progress line from the table, read without waiting on any worker
+    int intStages[MetricsStages] = {0};
+    int intDone = 0;
+    int intFailed = 0;
+    quint32 i = 0;
+    while (i < grtTable.Slots())
+    {
+        DtmResultEntry dreEntry;
+        if (grtTable.Read(i, &dreEntry) == true)
+        {
+            if (dreEntry.intExitCode == ResultPending)
+            {
+                if (dreEntry.intState < MetricsStages)
+                {
+                    ++intStages[dreEntry.intState];
+                }
+            }
+            else
+            {
+                ++intDone;
+                if (dreEntry.intExitCode != ExitCodeOK)
+                {
+                    ++intFailed;
+                }
+            }
+        }
+        ++i;
+    }
+
+    QTextStream tsOut(gpText);
+    tsOut << "[" << intDone << "/" << grtTable.Slots() << " done, " << intFailed << " failed]";
+    i = 1;
+    while (i < MetricsStages)
+    {
+        if (intStages[i] > 0 && DtmMetrics::StageName(i) != NULL)
+        {
+            tsOut << " " << DtmMetrics::StageName(i) << "=" << intStages[i];
+        }
+        ++i;
+    }
+    tsOut << "\n";
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmSupervisor::Finish(
+    )
+{
+    //Prints the result of every port and exits with the first failure (or OK)
+    gpReportTimer->stop();
+    Report();
+    gpSettings->sync();
+    QTextStream tsOut(gpText);
+    int intResult = ExitCodeOK;
+    int i = 0;
+    while (i < gslPorts.count())
+    {
+        tsOut << gslPorts[i] << "\t" << glstResults[i] << "\t" << glstRestarts[i] << " restarts";
+        QString strReason = DtmPortHealth::Reason(gpSettings, gslPorts[i]);
+        if (strReason.length() > 0)
+        {
+            //Health summary of ports which are drifting
+            tsOut << "\t" << (DtmPortHealth::IsQuarantined(gpSettings, gslPorts[i]) == true ? "quarantined: " : "drifting: ") << strReason;
+        }
+        tsOut << "\n";
+        if (intResult == ExitCodeOK && glstResults[i] != ExitCodeOK)
+        {
+            intResult = glstResults[i];
+        }
+        ++i;
+    }
+    tsOut.flush();
+    QCoreApplication::exit(intResult);
+}
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
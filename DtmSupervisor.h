@@ -0,0 +1,119 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmSupervisor.h
+**
+** Notes: Runs the escapes of many ports in worker processes pinned to
+**        cores, follows them through the shared result table and restarts
+**        workers which crash.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMSUPERVISOR_H
+#define DTMSUPERVISOR_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QObject>
+#include <QProcess>
+#include <QStringList>
+#include <QTimer>
+#include <QList>
+#include <QSettings>
+#include <stdio.h>
+#include "DtmResultTable.h"
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+const int                      SupervisorDefaultWorkers   = 64; //Most workers run at once when WORKERS= is not given, escapes wait on the module rather than the CPU
+const quint8                   SupervisorMaxRestarts      = 3; //Times a crashed worker is restarted before its port is failed
+const quint16                  SupervisorReportInterval   = 1000; //Time (in ms) between progress lines
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+class DtmSupervisor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DtmSupervisor(
+        QObject *parent = 0
+        );
+    ~DtmSupervisor(
+        );
+    static bool
+    IsRequested(
+        const QStringList &slArgs
+        );
+    static bool
+    PinToCore(
+        int intCore
+        );
+    bool
+    Start(
+        const QStringList &slArgs
+        );
+
+private slots:
+    void
+    WorkerFinished(
+        int intExitCode,
+        QProcess::ExitStatus pesStatus
+        );
+    void
+    WorkerError(
+        QProcess::ProcessError peeError
+        );
+    void
+    Report(
+        );
+
+private:
+    void
+    StartWorker(
+        int intSlot
+        );
+    void
+    StartPending(
+        );
+    void
+    Finish(
+        );
+
+    QStringList gslPorts; //Port of each slot
+    QStringList gslWorkerArgs; //Arguments passed on to every worker
+    QList<QProcess *> glstWorkers; //Running worker of each slot (NULL if none)
+    QList<quint8> glstRestarts; //Number of times each slot has been restarted
+    QList<qint32> glstResults; //Final result of each slot (ResultPending until known)
+    int gintNextSlot; //Next slot to start
+    int gintRunning; //Number of workers running
+    int gintMaxWorkers; //Number of workers allowed to run at once
+    int gintCores; //Number of cores workers are spread over
+    FILE *gpText; //Stream progress text is written to (stderr when stdout carries worker events)
+    bool gbQuarantine; //True to skip ports which have been quarantined
+    QSettings *gpSettings; //Settings shared with the workers, holds the health of each port
+    DtmResultTable grtTable; //Table the workers publish their state and result in
+    QTimer *gpReportTimer; //Timer used to print progress
+};
+
+#endif // DTMSUPERVISOR_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
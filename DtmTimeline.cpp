@@ -0,0 +1,190 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmTimeline.cpp
+**
+** Notes: Optional timeline tracer. Spans and instants are recorded into
+**        per-thread buffers without locks and written at exit as Chrome
+**        trace-event JSON (opens in Perfetto or chrome://tracing).
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include "DtmTimeline.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QSaveFile>
+
+/******************************************************************************/
+// Static Members
+/******************************************************************************/
+std::atomic<bool> DtmTimeline::gbEnabled(false);
+std::atomic<DtmTimelineBuffer *> DtmTimeline::gpBuffers(nullptr);
+std::atomic<quint32> DtmTimeline::gintThreads(0);
+QElapsedTimer DtmTimeline::gtmrClock;
+qint64 DtmTimeline::gintEpochOffset = 0;
+QString DtmTimeline::gstrFilename;
+QString DtmTimeline::gstrPort;
+
+//Buffer currently being filled by each thread
+static thread_local DtmTimelineBuffer *tpThreadBuffer = nullptr;
+static thread_local quint32 tintThread = 0;
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+bool
+DtmTimeline::Enable(
+    const QString &strFilename,
+    const QString &strPort
+    )
+{
+    //Starts recording, timestamps are from the epoch so traces of separate instances line up
+    if (strFilename.length() == 0)
+    {
+        return false;
+    }
+    gstrFilename = strFilename;
+    gstrPort = strPort;
+    gintEpochOffset = QDateTime::currentMSecsSinceEpoch()*1000;
+    gtmrClock.start();
+    gbEnabled.store(true, std::memory_order_release);
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+DtmTimelineBuffer *
+DtmTimeline::NewBuffer(
+    quint32 intThread
+    )
+{
+    //Allocates a buffer for a thread and pushes it on to the list of all buffers
+    DtmTimelineBuffer *pBuffer = new DtmTimelineBuffer;
+    pBuffer->intCount.store(0, std::memory_order_relaxed);
+    pBuffer->intThread = intThread;
+    pBuffer->pNext = gpBuffers.load(std::memory_order_relaxed);
+    while (!gpBuffers.compare_exchange_weak(pBuffer->pNext, pBuffer, std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+    return pBuffer;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmTimeline::Record(
+    const char *pName,
+    const char *pCategory,
+    char chPhase,
+    qint64 intArg
+    )
+{
+    //Appends an event to the buffer of the calling thread, only this thread writes to it
+    if (gbEnabled.load(std::memory_order_relaxed) == false)
+    {
+        return;
+    }
+
+    if (tpThreadBuffer == nullptr || tpThreadBuffer->intCount.load(std::memory_order_relaxed) >= TimelineBufferEvents)
+    {
+        if (tintThread == 0)
+        {
+            tintThread = gintThreads.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+        tpThreadBuffer = NewBuffer(tintThread);
+    }
+
+    quint32 intIndex = tpThreadBuffer->intCount.load(std::memory_order_relaxed);
+    DtmTimelineEvent *pEvent = &tpThreadBuffer->dteEvents[intIndex];
+    pEvent->pName = pName;
+    pEvent->pCategory = pCategory;
+    pEvent->chPhase = chPhase;
+    pEvent->intTimestamp = gintEpochOffset + gtmrClock.nsecsElapsed()/1000;
+    pEvent->intArg = intArg;
+    tpThreadBuffer->intCount.store(intIndex + 1, std::memory_order_release);
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmTimeline::Flush(
+    )
+{
+    //Writes every recorded event as trace-event JSON
+    if (gbEnabled.load(std::memory_order_acquire) == false)
+    {
+        return false;
+    }
+
+    QSaveFile fileTrace(gstrFilename);
+    if (!fileTrace.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+
+    QByteArray baPID = QByteArray::number(QCoreApplication::applicationPid());
+    QByteArray baPort = gstrPort.toUtf8().replace("\\", "\\\\").replace("\"", "\\\"");
+    QByteArray baOutput;
+    baOutput.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    baOutput.append("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":").append(baPID).append(",\"tid\":0,\"args\":{\"name\":\"ExitDTM ").append(baPort).append("\"}}");
+
+    DtmTimelineBuffer *pBuffer = gpBuffers.load(std::memory_order_acquire);
+    while (pBuffer != nullptr)
+    {
+        quint32 intCount = pBuffer->intCount.load(std::memory_order_acquire);
+        quint32 i = 0;
+        while (i < intCount)
+        {
+            const DtmTimelineEvent *pEvent = &pBuffer->dteEvents[i];
+            baOutput.append(",\n{\"name\":\"").append(pEvent->pName).append("\",\"cat\":\"").append(pEvent->pCategory).append("\",\"ph\":\"").append(pEvent->chPhase).append("\",\"ts\":").append(QByteArray::number(pEvent->intTimestamp)).append(",\"pid\":").append(baPID).append(",\"tid\":").append(QByteArray::number(pBuffer->intThread));
+            if (pEvent->chPhase == TimelinePhaseAsyncBegin || pEvent->chPhase == TimelinePhaseAsyncEnd)
+            {
+                //Async events are grouped by id, one track per port
+                baOutput.append(",\"id\":").append(baPID);
+            }
+            else if (pEvent->chPhase == TimelinePhaseInstant)
+            {
+                baOutput.append(",\"s\":\"t\"");
+            }
+            if (pEvent->intArg >= 0)
+            {
+                baOutput.append(",\"args\":{\"port\":\"").append(baPort).append("\",\"value\":").append(QByteArray::number(pEvent->intArg)).append("}");
+            }
+            baOutput.append("}");
+            ++i;
+        }
+
+        if (baOutput.length() > 65536)
+        {
+            //Write out in chunks
+            fileTrace.write(baOutput);
+            baOutput.clear();
+        }
+        pBuffer = pBuffer->pNext;
+    }
+    baOutput.append("\n]}\n");
+    fileTrace.write(baOutput);
+
+    return fileTrace.commit();
+}
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
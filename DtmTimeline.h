@@ -0,0 +1,144 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmTimeline.h
+**
+** Notes: Optional timeline tracer. Spans and instants are recorded into
+**        per-thread buffers without locks and written at exit as Chrome
+**        trace-event JSON (opens in Perfetto or chrome://tracing).
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMTIMELINE_H
+#define DTMTIMELINE_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QString>
+#include <QElapsedTimer>
+#include <atomic>
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+const quint16                  TimelineBufferEvents       = 4096; //Events per buffer, a thread chains another buffer when full
+
+//Event phases (trace-event format)
+const char                     TimelinePhaseBegin         = 'B';
+const char                     TimelinePhaseEnd           = 'E';
+const char                     TimelinePhaseInstant       = 'i';
+const char                     TimelinePhaseAsyncBegin    = 'b'; //Used for stages, which do not nest with other spans
+const char                     TimelinePhaseAsyncEnd      = 'e';
+
+/******************************************************************************/
+// Structures
+/******************************************************************************/
+struct DtmTimelineEvent
+{
+    const char *pName; //Event name (must be a string literal)
+    const char *pCategory; //Event category (must be a string literal)
+    char chPhase; //Event phase
+    qint64 intTimestamp; //Time (in us since the epoch)
+    qint64 intArg; //Optional argument (e.g. byte count), negative if none
+};
+
+struct DtmTimelineBuffer
+{
+    DtmTimelineEvent dteEvents[TimelineBufferEvents]; //Recorded events
+    std::atomic<quint32> intCount; //Number of events recorded, published after each event is written
+    quint32 intThread; //Thread the buffer belongs to
+    DtmTimelineBuffer *pNext; //Next buffer in the list of all buffers
+};
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+class DtmTimeline
+{
+public:
+    static bool
+    Enable(
+        const QString &strFilename,
+        const QString &strPort
+        );
+    static inline bool
+    IsEnabled(
+        )
+    {
+        return gbEnabled.load(std::memory_order_relaxed);
+    }
+    static void
+    Record(
+        const char *pName,
+        const char *pCategory,
+        char chPhase,
+        qint64 intArg = -1
+        );
+    static bool
+    Flush(
+        );
+
+private:
+    static DtmTimelineBuffer *
+    NewBuffer(
+        quint32 intThread
+        );
+
+    static std::atomic<bool> gbEnabled; //True once a file has been set
+    static std::atomic<DtmTimelineBuffer *> gpBuffers; //All buffers from all threads (lock-free list)
+    static std::atomic<quint32> gintThreads; //Number of threads which have recorded events
+    static QElapsedTimer gtmrClock; //Monotonic clock for timestamps
+    static qint64 gintEpochOffset; //Time (in us since the epoch) when the clock was started
+    static QString gstrFilename; //File the trace is written to
+    static QString gstrPort; //Port name shown as the process name
+};
+
+class DtmTimelineScope
+{
+public:
+    inline DtmTimelineScope(
+        const char *pName,
+        const char *pCategory,
+        qint64 intArg = -1
+        )
+    {
+        gpName = pName;
+        gpCategory = pCategory;
+        if (DtmTimeline::IsEnabled() == true)
+        {
+            DtmTimeline::Record(pName, pCategory, TimelinePhaseBegin, intArg);
+        }
+    }
+    inline ~DtmTimelineScope(
+        )
+    {
+        if (DtmTimeline::IsEnabled() == true)
+        {
+            DtmTimeline::Record(gpName, gpCategory, TimelinePhaseEnd);
+        }
+    }
+
+private:
+    const char *gpName; //Name of the span
+    const char *gpCategory; //Category of the span
+};
+
+#endif // DTMTIMELINE_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
@@ -0,0 +1,359 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmTrace.cpp
+**
+** Notes: Binary serial traffic capture (memory mapped, append only) and the
+**        matching reader used to replay a capture through the state machine
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include "DtmTrace.h"
+#include <QDateTime>
+#include <string.h>
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+DtmTraceWriter::DtmTraceWriter(
+    )
+{
+    gpMapping = NULL;
+    gintMappedSize = 0;
+    gintWritePosition = 0;
+    gintLastTimestamp = 0;
+}
+
+//=============================================================================
+//=============================================================================
+DtmTraceWriter::~DtmTraceWriter(
+    )
+{
+    Close();
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmTraceWriter::Open(
+    const QString &strFilename
+    )
+{
+    //Creates the trace file and writes the header
+    Close();
+    gfTraceFile.setFileName(strFilename);
+    if (!gfTraceFile.open(QIODevice::ReadWrite | QIODevice::Truncate))
+    {
+        //Unable to create file
+        return false;
+    }
+
+    gintWritePosition = 0;
+    gintLastTimestamp = 0;
+    if (!Reserve(TraceFileHeaderSize))
+    {
+        //Unable to map file
+        gfTraceFile.close();
+        return false;
+    }
+
+    memcpy(gpMapping, TraceFileMagic, 7);
+    gpMapping[7] = TraceFileVersion;
+    qToLittleEndian<quint64>(QDateTime::currentMSecsSinceEpoch(), gpMapping + 8);
+    gintWritePosition = TraceFileHeaderSize;
+    gtmrTimestamp.start();
+
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmTraceWriter::Close(
+    )
+{
+    //Unmaps the file and truncates it to the length actually written
+    if (gpMapping != NULL)
+    {
+        gfTraceFile.unmap(gpMapping);
+        gpMapping = NULL;
+        gintMappedSize = 0;
+    }
+
+    if (gfTraceFile.isOpen())
+    {
+        gfTraceFile.resize(gintWritePosition);
+        gfTraceFile.close();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmTraceWriter::IsOpen(
+    ) const
+{
+    return (gpMapping != NULL);
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmTraceWriter::Reserve(
+    qint64 intLength
+    )
+{
+    //Ensures there is enough mapped space for the next write, growing the file in whole chunks
+    if (gpMapping != NULL && gintWritePosition + intLength <= gintMappedSize)
+    {
+        return true;
+    }
+
+    qint64 intNewSize = gintMappedSize + TraceFileChunkSize;
+    while (intNewSize < gintWritePosition + intLength)
+    {
+        intNewSize += TraceFileChunkSize;
+    }
+
+    if (gpMapping != NULL)
+    {
+        gfTraceFile.unmap(gpMapping);
+        gpMapping = NULL;
+    }
+
+    if (!gfTraceFile.resize(intNewSize))
+    {
+        gintMappedSize = 0;
+        return false;
+    }
+
+    gpMapping = gfTraceFile.map(0, intNewSize);
+    gintMappedSize = (gpMapping == NULL ? 0 : intNewSize);
+
+    return (gpMapping != NULL);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmTraceWriter::Record(
+    quint8 intType,
+    const char *pData,
+    qint64 intLength
+    )
+{
+    //Appends a record, data longer than a record can hold is split
+    if (gpMapping == NULL)
+    {
+        return;
+    }
+
+    qint64 intNow = gtmrTimestamp.nsecsElapsed()/1000;
+    do
+    {
+        quint16 intChunk = (intLength > 0xffff ? 0xffff : (quint16)intLength);
+        if (!Reserve(TraceRecordHeaderSize + intChunk))
+        {
+            //Out of space, stop tracing
+            Close();
+            return;
+        }
+
+        uchar *pRecord = gpMapping + gintWritePosition;
+        qint64 intDelta = intNow - gintLastTimestamp;
+        qToLittleEndian<quint32>((intDelta > 0xffffffff ? 0xffffffff : (quint32)intDelta), pRecord);
+        pRecord[4] = intType;
+        qToLittleEndian<quint16>(intChunk, pRecord + 5);
+        if (intChunk > 0)
+        {
+            memcpy(pRecord + TraceRecordHeaderSize, pData, intChunk);
+        }
+        gintWritePosition += TraceRecordHeaderSize + intChunk;
+        gintLastTimestamp = intNow;
+
+        pData += intChunk;
+        intLength -= intChunk;
+    } while (intLength > 0);
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmTraceWriter::RecordSignals(
+    quint32 intSignals
+    )
+{
+    //Records a change of the modem lines
+    uchar baPayload[4];
+    qToLittleEndian<quint32>(intSignals, baPayload);
+    Record(TraceRecordSignals, (const char *)baPayload, sizeof(baPayload));
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmTraceWriter::RecordOpen(
+    quint32 intBaud,
+    quint8 intFlow
+    )
+{
+    //Records the port being (re)opened
+    uchar baPayload[5];
+    qToLittleEndian<quint32>(intBaud, baPayload);
+    baPayload[4] = intFlow;
+    Record(TraceRecordOpen, (const char *)baPayload, sizeof(baPayload));
+}
+
+//=============================================================================
+//=============================================================================
+DtmTraceReader::DtmTraceReader(
+    )
+{
+    gpMapping = NULL;
+    gintMappedSize = 0;
+    gintReadPosition = 0;
+}
+
+//=============================================================================
+//=============================================================================
+DtmTraceReader::~DtmTraceReader(
+    )
+{
+    Close();
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmTraceReader::Open(
+    const QString &strFilename
+    )
+{
+    //Maps a trace file and checks the header
+    Close();
+    gfTraceFile.setFileName(strFilename);
+    if (!gfTraceFile.open(QIODevice::ReadOnly) || gfTraceFile.size() < TraceFileHeaderSize)
+    {
+        //Unable to open file or file too small
+        gfTraceFile.close();
+        return false;
+    }
+
+    gintMappedSize = gfTraceFile.size();
+    gpMapping = gfTraceFile.map(0, gintMappedSize);
+    if (gpMapping == NULL || memcmp(gpMapping, TraceFileMagic, 7) != 0 || gpMapping[7] != TraceFileVersion)
+    {
+        //Not a trace file or unsupported version
+        Close();
+        return false;
+    }
+
+    gintReadPosition = TraceFileHeaderSize;
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmTraceReader::Close(
+    )
+{
+    if (gpMapping != NULL)
+    {
+        gfTraceFile.unmap(gpMapping);
+        gpMapping = NULL;
+    }
+    gintMappedSize = 0;
+    gintReadPosition = 0;
+    gfTraceFile.close();
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmTraceReader::Next(
+    DtmTraceRecord *pRecord
+    )
+{
+    //Reads the next record, returns false at the end of the trace or if the trace is truncated
+    if (gpMapping == NULL || gintReadPosition + TraceRecordHeaderSize > gintMappedSize)
+    {
+        return false;
+    }
+
+    const uchar *pHeader = gpMapping + gintReadPosition;
+    quint16 intLength = qFromLittleEndian<quint16>(pHeader + 5);
+    if (gintReadPosition + TraceRecordHeaderSize + intLength > gintMappedSize)
+    {
+        //Truncated record
+        return false;
+    }
+
+    pRecord->intDelta = qFromLittleEndian<quint32>(pHeader);
+    pRecord->intType = pHeader[4];
+    pRecord->baData = QByteArray::fromRawData((const char *)pHeader + TraceRecordHeaderSize, intLength);
+    gintReadPosition += TraceRecordHeaderSize + intLength;
+
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+void
+DtmTraceReader::Rewind(
+    )
+{
+    //Moves back to the first record
+    if (gpMapping != NULL)
+    {
+        gintReadPosition = TraceFileHeaderSize;
+    }
+}
+
+//=============================================================================
+//=============================================================================
+bool
+DtmTraceReader::FirstSignals(
+    quint32 *pSignals
+    )
+{
+    //Finds the state of the modem lines when the port was first opened
+    DtmTraceRecord dtrRecord;
+    qint64 intPosition = gintReadPosition;
+    bool bFound = false;
+
+    Rewind();
+    while (Next(&dtrRecord) == true)
+    {
+        if (dtrRecord.intType == TraceRecordSignals && dtrRecord.baData.length() == 4)
+        {
+            *pSignals = qFromLittleEndian<quint32>((const uchar *)dtrRecord.baData.constData());
+            bFound = true;
+            break;
+        }
+    }
+    gintReadPosition = intPosition;
+
+    return bFound;
+}
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
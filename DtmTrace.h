@@ -0,0 +1,150 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: DtmTrace.h
+**
+** Notes: Binary serial traffic capture (memory mapped, append only) and the
+**        matching reader used to replay a capture through the state machine
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+#ifndef DTMTRACE_H
+#define DTMTRACE_H
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QFile>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QtEndian>
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+//File layout: 8 byte magic/version, 8 byte start time (ms since epoch, LE),
+//then records of: 4 byte delta time (us, LE), 1 byte type, 2 byte length
+//(LE), payload
+const char                     TraceFileMagic[]           = "EXDTMTR"; //Magic string at start of a trace file (followed by version byte)
+const quint8                   TraceFileVersion           = 1;
+const quint8                   TraceFileHeaderSize        = 16;
+const quint8                   TraceRecordHeaderSize      = 7;
+const qint64                   TraceFileChunkSize         = 65536; //Size the mapped region is grown by when full
+
+//Record types
+const quint8                   TraceRecordRX              = 1; //Payload: received bytes
+const quint8                   TraceRecordTX              = 2; //Payload: transmitted bytes
+const quint8                   TraceRecordSignals         = 3; //Payload: 4 byte pinout signals (LE)
+const quint8                   TraceRecordOpen            = 4; //Payload: 4 byte baud rate (LE), 1 byte flow control
+
+/******************************************************************************/
+// Structures
+/******************************************************************************/
+struct DtmTraceRecord
+{
+    quint32 intDelta; //Time (in us) since the previous record
+    quint8 intType; //Record type
+    QByteArray baData; //Payload, references the mapped file (no copy)
+};
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+class DtmTraceWriter
+{
+public:
+    DtmTraceWriter(
+        );
+    ~DtmTraceWriter(
+        );
+    bool
+    Open(
+        const QString &strFilename
+        );
+    void
+    Close(
+        );
+    bool
+    IsOpen(
+        ) const;
+    void
+    Record(
+        quint8 intType,
+        const char *pData,
+        qint64 intLength
+        );
+    void
+    RecordSignals(
+        quint32 intSignals
+        );
+    void
+    RecordOpen(
+        quint32 intBaud,
+        quint8 intFlow
+        );
+
+private:
+    bool
+    Reserve(
+        qint64 intLength
+        );
+
+    QFile gfTraceFile; //File being written to
+    uchar *gpMapping; //Start of the mapped region of the file
+    qint64 gintMappedSize; //Size of the mapped region
+    qint64 gintWritePosition; //Offset of the next record
+    QElapsedTimer gtmrTimestamp; //Time since the trace was started
+    qint64 gintLastTimestamp; //Time (in us) of the previous record
+};
+
+class DtmTraceReader
+{
+public:
+    DtmTraceReader(
+        );
+    ~DtmTraceReader(
+        );
+    bool
+    Open(
+        const QString &strFilename
+        );
+    void
+    Close(
+        );
+    bool
+    Next(
+        DtmTraceRecord *pRecord
+        );
+    void
+    Rewind(
+        );
+    bool
+    FirstSignals(
+        quint32 *pSignals
+        );
+
+private:
+    QFile gfTraceFile; //File being read from
+    uchar *gpMapping; //Start of the mapped file
+    qint64 gintMappedSize; //Size of the mapped file
+    qint64 gintReadPosition; //Offset of the next record
+};
+
+#endif // DTMTRACE_H
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
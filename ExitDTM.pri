@@ -0,0 +1,52 @@
+#Sources shared by the application and the tests (everything except main.cpp)
+QT       += core gui widgets serialport
+
+#Coroutine sessions need C++20
+CONFIG += c++2a
+
+INCLUDEPATH += $$PWD
+
+SOURCES += $$PWD/DtmMainWindow.cpp\
+    $$PWD/DtmTrace.cpp\
+    $$PWD/DtmMetrics.cpp\
+    $$PWD/DtmAdapterProfile.cpp\
+    $$PWD/DtmHubScheduler.cpp\
+    $$PWD/DtmSession.cpp\
+    $$PWD/DtmLicenseStore.cpp\
+    $$PWD/DtmTimeline.cpp\
+    $$PWD/DtmRingBuffer.cpp\
+    $$PWD/DtmClock.cpp\
+    $$PWD/DtmResultTable.cpp\
+    $$PWD/DtmSupervisor.cpp\
+    $$PWD/DtmLoopMonitor.cpp\
+    $$PWD/DtmStatusBlock.cpp\
+    $$PWD/DtmPortHealth.cpp\
+    $$PWD/DtmEvents.cpp\
+    $$PWD/DtmSeqLock.cpp
+
+HEADERS  += $$PWD/DtmMainWindow.h\
+    $$PWD/DtmConstants.h\
+    $$PWD/DtmTrace.h\
+    $$PWD/DtmMetrics.h\
+    $$PWD/DtmAdapterProfile.h\
+    $$PWD/DtmHubScheduler.h\
+    $$PWD/DtmSession.h\
+    $$PWD/DtmLicenseStore.h\
+    $$PWD/DtmTimeline.h\
+    $$PWD/DtmRingBuffer.h\
+    $$PWD/DtmClock.h\
+    $$PWD/DtmResultTable.h\
+    $$PWD/DtmSupervisor.h\
+    $$PWD/DtmLoopMonitor.h\
+    $$PWD/DtmStatusBlock.h\
+    $$PWD/DtmPortHealth.h\
+    $$PWD/DtmEvents.h\
+    $$PWD/DtmSeqLock.h
+
+FORMS    += $$PWD/DtmMainWindow.ui
+
+#Windows peak memory usage for the startup benchmark
+win32:LIBS += -lpsapi
+
+#Shared memory status block (shm_open is in librt on older glibc)
+unix:!macx:LIBS += -lrt
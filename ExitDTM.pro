@@ -1,14 +1,10 @@
-QT       += core gui widgets serialport
-
 TARGET = ExitDTM
 TEMPLATE = app
 
-SOURCES += main.cpp\
-    DtmMainWindow.cpp
-
-HEADERS  += DtmMainWindow.h
+#Application sources, shared with the tests
+include(ExitDTM.pri)
 
-FORMS    += DtmMainWindow.ui
+SOURCES += main.cpp
 
 RESOURCES +=
 
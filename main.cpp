@@ -25,12 +25,18 @@
 // Include Files
 /******************************************************************************/
 #include "DtmMainWindow.h"
+#include "DtmSupervisor.h"
 #include <QApplication>
 #include <QCommandLineParser>
 #if TARGET_OS_MAC
 #include <QStyleFactory>
 #endif
 
+/******************************************************************************/
+// Global Variables
+/******************************************************************************/
+QElapsedTimer gtmrProcessStart; //Started before anything else, used to measure startup
+
 //=============================================================================
 //=============================================================================
 int
@@ -39,11 +45,22 @@ main(
     char *argv[]
     )
 {
+    gtmrProcessStart.start();
     QApplication a(argc, argv);
 #if TARGET_OS_MAC
     //Fix for Mac to stop bad styling
     QApplication::setStyle(QStyleFactory::create("Fusion"));
 #endif
+    if (DtmSupervisor::IsRequested(QCoreApplication::arguments()) == true)
+    {
+        //Escape the ports in worker processes instead of showing a window
+        DtmSupervisor dsSupervisor;
+        if (dsSupervisor.Start(QCoreApplication::arguments()) == false)
+        {
+            return ExitCodeInvalidPort;
+        }
+        return a.exec();
+    }
     MainWindow w;
 
     return a.exec();
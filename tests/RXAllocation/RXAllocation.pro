@@ -0,0 +1,11 @@
+QT       += testlib
+
+TARGET = TestRXAllocation
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+#Application sources
+include(../../ExitDTM.pri)
+
+SOURCES += TestRXAllocation.cpp
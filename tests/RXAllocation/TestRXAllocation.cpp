@@ -0,0 +1,444 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: TestRXAllocation.cpp
+**
+** Notes: Checks that the serial receive path does not allocate once it has
+**        warmed up. The global allocation functions are replaced with ones
+**        which count calls whilst a measurement is running.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QtTest>
+#include <QApplication>
+#include <QIODevice>
+#include <QTemporaryDir>
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include "DtmMainWindow.h"
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+const quint32                  TestWarmupChunks           = 4096; //Chunks received before counting, enough to fill and trim every buffer
+const quint32                  TestCountedChunks          = 20000; //Chunks received whilst counting
+const qint64                   TestChunkSizes[]           = {1, 7, 64, 300, 1024, 4096}; //Sizes of the bursts the device returns
+const quint8                   TestChunkSizeCount         = 6;
+
+/******************************************************************************/
+// Global Variables
+/******************************************************************************/
+QElapsedTimer gtmrProcessStart; //Normally defined by main.cpp
+static std::atomic<bool> gbCounting(false); //True whilst allocations are counted
+static std::atomic<quint64> gintAllocations(0); //Allocations made whilst counting
+
+/******************************************************************************/
+// Counting allocator
+/******************************************************************************/
+#ifdef __GLIBC__
+//Qt containers allocate with malloc rather than new, so both are counted. The
+//glibc entry points are used directly to avoid counting anything twice
+extern "C" void *__libc_malloc(size_t intSize);
+extern "C" void *__libc_calloc(size_t intCount, size_t intSize);
+extern "C" void *__libc_realloc(void *pMemory, size_t intSize);
+extern "C" void __libc_free(void *pMemory);
+#define RawAllocate(x) __libc_malloc(x)
+#define RawFree(x) __libc_free(x)
+#else
+//Only new is counted on other platforms
+#define RawAllocate(x) malloc(x)
+#define RawFree(x) free(x)
+#endif
+
+static inline void
+CountAllocation(
+    )
+{
+    if (gbCounting.load(std::memory_order_relaxed) == true)
+    {
+        gintAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+#ifdef __GLIBC__
+extern "C" void *
+malloc(
+    size_t intSize
+    )
+{
+    CountAllocation();
+    return __libc_malloc(intSize);
+}
+
+extern "C" void *
+calloc(
+    size_t intCount,
+    size_t intSize
+    )
+{
+    CountAllocation();
+    return __libc_calloc(intCount, intSize);
+}
+
+extern "C" void *
+realloc(
+    void *pMemory,
+    size_t intSize
+    )
+{
+    CountAllocation();
+    return __libc_realloc(pMemory, intSize);
+}
+
+extern "C" void
+free(
+    void *pMemory
+    )
+{
+    __libc_free(pMemory);
+}
+#endif
+
+void *
+operator new(
+    size_t intSize
+    )
+{
+    CountAllocation();
+    void *pMemory = RawAllocate(intSize > 0 ? intSize : 1);
+    if (pMemory == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return pMemory;
+}
+
+void *
+operator new[](
+    size_t intSize
+    )
+{
+    return operator new(intSize);
+}
+
+void *
+operator new(
+    size_t intSize,
+    const std::nothrow_t &
+    ) noexcept
+{
+    CountAllocation();
+    return RawAllocate(intSize > 0 ? intSize : 1);
+}
+
+void *
+operator new[](
+    size_t intSize,
+    const std::nothrow_t &
+    ) noexcept
+{
+    CountAllocation();
+    return RawAllocate(intSize > 0 ? intSize : 1);
+}
+
+void
+operator delete(
+    void *pMemory
+    ) noexcept
+{
+    RawFree(pMemory);
+}
+
+void
+operator delete[](
+    void *pMemory
+    ) noexcept
+{
+    RawFree(pMemory);
+}
+
+void
+operator delete(
+    void *pMemory,
+    size_t
+    ) noexcept
+{
+    RawFree(pMemory);
+}
+
+void
+operator delete[](
+    void *pMemory,
+    size_t
+    ) noexcept
+{
+    RawFree(pMemory);
+}
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+//Unbuffered device which returns one burst of module output per Feed()
+class TestSerialDevice : public QIODevice
+{
+public:
+    TestSerialDevice(
+        )
+    {
+        gintAvailable = 0;
+        gintPosition = 0;
+        quint32 i = 0;
+        while (i < sizeof(gbaPattern))
+        {
+            //DTM output is mostly binary, with the odd line ending. Consecutive bytes differ by 37 so no line ever starts with a 00, 01 or 10 response
+            gbaPattern[i] = (i % 61 == 60 ? '\n' : i % 61 == 59 ? '\r' : (char)((i*37 + 11) & 0xff));
+            ++i;
+        }
+    }
+    void
+    Feed(
+        qint64 intLength
+        )
+    {
+        gintAvailable = intLength;
+    }
+    bool
+    isSequential(
+        ) const override
+    {
+        return true;
+    }
+
+protected:
+    qint64
+    readData(
+        char *pData,
+        qint64 intMaxLength
+        ) override
+    {
+        qint64 intLength = qMin(intMaxLength, gintAvailable);
+        qint64 i = 0;
+        while (i < intLength)
+        {
+            pData[i] = gbaPattern[gintPosition];
+            gintPosition = (gintPosition + 1) % sizeof(gbaPattern);
+            ++i;
+        }
+        gintAvailable -= intLength;
+        return intLength;
+    }
+    qint64
+    writeData(
+        const char *,
+        qint64
+        ) override
+    {
+        return -1;
+    }
+
+private:
+    char gbaPattern[8191]; //Data returned, a length which is not a multiple of any burst
+    qint64 gintAvailable; //Bytes left in the current burst
+    quint32 gintPosition; //Next byte of the pattern
+};
+
+class TestRXAllocation : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void
+    initTestCase(
+        );
+    void
+    cleanupTestCase(
+        );
+    void
+    WaitingForCTS(
+        );
+    void
+    WaitingForErase(
+        );
+    void
+    Identify(
+        );
+    void
+    LicenseInstall(
+        );
+    void
+    LicenseCheck(
+        );
+    void
+    Idle(
+        );
+
+private:
+    quint64
+    Receive(
+        quint8 intState
+        );
+
+    QTemporaryDir gtdSettings; //Settings written by the window go here rather than the user's
+    MainWindow *gpWindow; //Window under test
+};
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+void
+TestRXAllocation::initTestCase(
+    )
+{
+    QVERIFY(gtdSettings.isValid() == true);
+    QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, gtdSettings.path());
+    gpWindow = new MainWindow();
+
+    //Redraws are deferred to a timer whilst the window is shown, the data path itself is what is measured
+    gpWindow->hide();
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestRXAllocation::cleanupTestCase(
+    )
+{
+    delete gpWindow;
+}
+
+//=============================================================================
+//=============================================================================
+quint64
+TestRXAllocation::Receive(
+    quint8 intState
+    )
+{
+    //Feeds bursts of every size through the receive path, returning the allocations made once warmed up
+    TestSerialDevice tsdDevice;
+    tsdDevice.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    gpWindow->gintProgramState = intState;
+    quint32 i = 0;
+    while (i < TestWarmupChunks)
+    {
+        tsdDevice.Feed(TestChunkSizes[i % TestChunkSizeCount]);
+        gpWindow->ReadDevice(&tsdDevice);
+        ++i;
+    }
+
+    gintAllocations = 0;
+    gbCounting = true;
+    i = 0;
+    while (i < TestCountedChunks)
+    {
+        tsdDevice.Feed(TestChunkSizes[i % TestChunkSizeCount]);
+        gpWindow->ReadDevice(&tsdDevice);
+        ++i;
+    }
+    gbCounting = false;
+    gpWindow->gintProgramState = ProgramStatusIdle;
+    return gintAllocations.load();
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestRXAllocation::WaitingForCTS(
+    )
+{
+    //Module output whilst the exit DTM command is outstanding
+    QCOMPARE(Receive(ProgramStatusExitDTM), (quint64)0);
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestRXAllocation::WaitingForErase(
+    )
+{
+    //Lines which never contain the erase confirmation
+    QCOMPARE(Receive(ProgramStatusEraseFS), (quint64)0);
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestRXAllocation::Identify(
+    )
+{
+    //Lines which never complete the device type response
+    QCOMPARE(Receive(ProgramStatusIdentify), (quint64)0);
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestRXAllocation::LicenseInstall(
+    )
+{
+    //Lines which never finish the license write
+    QCOMPARE(Receive(ProgramStatusLicenseInstall), (quint64)0);
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestRXAllocation::LicenseCheck(
+    )
+{
+    //Lines which never finish the license and address queries
+    QCOMPARE(Receive(ProgramStatusLicenseCheck), (quint64)0);
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestRXAllocation::Idle(
+    )
+{
+    //Data received with nothing outstanding is only displayed
+    QCOMPARE(Receive(ProgramStatusIdle), (quint64)0);
+}
+
+//=============================================================================
+//=============================================================================
+int
+main(
+    int argc,
+    char *argv[]
+    )
+{
+    gtmrProcessStart.start();
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM") == true)
+    {
+        //Run without a display
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication a(argc, argv);
+    TestRXAllocation tratTest;
+    return QTest::qExec(&tratTest, argc, argv);
+}
+
+#include "TestRXAllocation.moc"
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
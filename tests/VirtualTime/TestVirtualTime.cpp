@@ -0,0 +1,562 @@
+/******************************************************************************
+** Copyright (C) 2018 Laird
+**
+** Project: ExitDTM
+**
+** Module: TestVirtualTime.cpp
+**
+** Notes: Runs the escape state machine against a scripted module on a
+**        virtual clock, so thousands of escapes and every timeout branch
+**        can be checked without waiting for real time to pass.
+**
+** License: This program is free software: you can redistribute it and/or
+**          modify it under the terms of the GNU General Public License as
+**          published by the Free Software Foundation, version 3.
+**
+**          This program is distributed in the hope that it will be useful,
+**          but WITHOUT ANY WARRANTY; without even the implied warranty of
+**          MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**          GNU General Public License for more details.
+**
+**          You should have received a copy of the GNU General Public License
+**          along with this program.  If not, see http://www.gnu.org/licenses/
+**
+*******************************************************************************/
+
+/******************************************************************************/
+// Include Files
+/******************************************************************************/
+#include <QtTest>
+#include <QApplication>
+#include <QTemporaryDir>
+#include "DtmMainWindow.h"
+#include "ui_DtmMainWindow.h"
+
+/******************************************************************************/
+// Constants
+/******************************************************************************/
+const quint32                  TestEscapeCount            = 2000; //Escapes run by the repeated tests
+const quint32                  TestTimeoutCount           = 200; //Escapes run by each timeout test
+const quint32                  TestMaxEventLoops          = 100000; //Event loop passes before an escape is considered stuck
+const quint16                  TestResetTime              = 35; //Time (in ms) the module takes to reboot out of DTM
+const quint16                  TestResponseTime           = 4; //Time (in ms) the module takes to answer a command
+const char                     TestLicense[]              = "0016A4123456"; //Valid license returned by at i 4
+const char                     TestAddress[]              = "0016A4ABCDEF"; //Address returned by at i 14
+const char                     TestFirmware[]             = "29.4.6.0"; //Firmware version returned by at i 3
+const char                     TestDeviceType[]           = "BL654"; //Device type returned by at i 0
+const quint8                   TestNeverExit              = 255; //Exit DTM commands ignored by a module which never leaves DTM
+
+/******************************************************************************/
+// Global Variables
+/******************************************************************************/
+QElapsedTimer gtmrProcessStart; //Normally defined by main.cpp
+
+/******************************************************************************/
+// Class definitions
+/******************************************************************************/
+//How the scripted module behaves for one escape
+struct TestScript
+{
+    quint8 intIgnoredExits = 0; //Exit DTM commands ignored before the module leaves DTM
+    bool bCTSAtOpen = false; //True if CTS is already asserted when the port is opened
+    bool bAnswerIdentify = true; //True to answer the firmware and device type queries
+    bool bAnswerErase = true; //True to answer the clear configuration command
+    bool bAnswerLicense = true; //True to answer the license and address queries
+    bool bLicensed = true; //True to report a valid license
+};
+
+//Module on the far side of the replay port, answering what the state machine sends on the virtual clock
+class TestScriptedModule : public QObject
+{
+    Q_OBJECT
+
+public:
+    TestScriptedModule(
+        MainWindow *pWindow
+        );
+    void
+    Reset(
+        const TestScript &tsScript
+        );
+    quint8
+    ExitCommands(
+        ) const
+    {
+        return gintExitCommands;
+    }
+
+private slots:
+    void
+    Written(
+        const QByteArray &baData
+        );
+    void
+    ResetFinished(
+        );
+    void
+    Respond(
+        );
+
+private:
+    void
+    Command(
+        const QByteArray &baCommand
+        );
+
+    MainWindow *gpWindow; //Window whose replay port the module is attached to
+    TestScript gtsScript; //Behaviour for the current escape
+    bool gbInDTM; //True until the module has rebooted out of DTM
+    quint8 gintExitCommands; //Exit DTM commands received
+    QByteArray gbaCommand; //Interactive mode command received so far
+    QByteArray gbaResponses; //Responses waiting to be sent
+    DtmTimer gtmrReset; //Module reboot after the exit DTM command
+    DtmTimer gtmrRespond; //Delay before responses are sent
+};
+
+class TestVirtualTime : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void
+    initTestCase(
+        );
+    void
+    cleanupTestCase(
+        );
+    void
+    init(
+        );
+    void
+    Escapes(
+        );
+    void
+    Retries(
+        );
+    void
+    CTSAsserted(
+        );
+    void
+    ExitTimeout(
+        );
+    void
+    EraseTimeout(
+        );
+    void
+    LicenseTimeout(
+        );
+    void
+    IdentifyTimeout(
+        );
+    void
+    EscapeFinished(
+        int intExitCode
+        );
+
+private:
+    int
+    Escape(
+        const TestScript &tsScript
+        );
+
+    QTemporaryDir gtdSettings; //Settings written by the window go here rather than the user's
+    MainWindow *gpWindow; //Window under test
+    TestScriptedModule *gpModule; //Module attached to the window
+    bool gbFinished; //True once the current escape has a result
+    int gintResult; //Result of the last escape
+    qint64 gintElapsed; //Virtual time (in ns) the last escape took
+};
+
+/******************************************************************************/
+// Local Functions or Private Members
+/******************************************************************************/
+TestScriptedModule::TestScriptedModule(
+    MainWindow *pWindow
+    ) : QObject(pWindow)
+{
+    gpWindow = pWindow;
+    gbInDTM = true;
+    gintExitCommands = 0;
+    gtmrReset.setSingleShot(true);
+    gtmrReset.setInterval(TestResetTime);
+    gtmrRespond.setSingleShot(true);
+    gtmrRespond.setInterval(TestResponseTime);
+    connect(pWindow, SIGNAL(ReplayWrite(QByteArray)), this, SLOT(Written(QByteArray)));
+    connect(&gtmrReset, SIGNAL(timeout()), this, SLOT(ResetFinished()));
+    connect(&gtmrRespond, SIGNAL(timeout()), this, SLOT(Respond()));
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestScriptedModule::Reset(
+    const TestScript &tsScript
+    )
+{
+    //A new module in DTM is fitted
+    gtsScript = tsScript;
+    gbInDTM = true;
+    gintExitCommands = 0;
+    gbaCommand.clear();
+    gbaResponses.clear();
+    gtmrReset.stop();
+    gtmrRespond.stop();
+    gpWindow->gintReplaySignals = (tsScript.bCTSAtOpen == true ? QSerialPort::ClearToSendSignal : 0);
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestScriptedModule::Written(
+    const QByteArray &baData
+    )
+{
+    //Data sent by the state machine, in DTM only the exit command is understood
+    if (gbInDTM == true)
+    {
+        if (baData.indexOf(QByteArray().append((char)DTMExitCMDA).append((char)DTMExitCMDB)) != -1)
+        {
+            ++gintExitCommands;
+            if (gtsScript.intIgnoredExits != TestNeverExit && gintExitCommands > gtsScript.intIgnoredExits && gtmrReset.isActive() == false)
+            {
+                gtmrReset.start();
+            }
+        }
+        return;
+    }
+
+    int i = 0;
+    while (i < baData.length())
+    {
+        if (baData[i] == '\r')
+        {
+            Command(gbaCommand);
+            gbaCommand.clear();
+        }
+        else
+        {
+            gbaCommand.append(baData[i]);
+        }
+        ++i;
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestScriptedModule::Command(
+    const QByteArray &baCommand
+    )
+{
+    //Queues the response to an interactive mode command
+    if (baCommand == "at&f*" && gtsScript.bAnswerErase == true)
+    {
+        gbaResponses.append("\nFFS Erased, Rebooting...\r\n00\r");
+    }
+    else if (baCommand == "at i 4" && gtsScript.bAnswerLicense == true)
+    {
+        gbaResponses.append("\n10\t4\t00 ").append(gtsScript.bLicensed == true ? QByteArray(TestLicense) : LicensePlaceholder.toUtf8()).append("\r\n00\r");
+    }
+    else if (baCommand == "at i 14" && gtsScript.bAnswerLicense == true)
+    {
+        gbaResponses.append("\n10\t14\t01 ").append(TestAddress).append("\r\n00\r");
+    }
+    else if (baCommand == IdentifyFirmwareQuery && gtsScript.bAnswerIdentify == true)
+    {
+        gbaResponses.append("\n10\t3\t").append(TestFirmware).append("\r\n00\r");
+    }
+    else if (baCommand == IdentifyTypeQuery && gtsScript.bAnswerIdentify == true)
+    {
+        gbaResponses.append("\n10\t0\t").append(TestDeviceType).append("\r\n00\r");
+    }
+    else
+    {
+        return;
+    }
+
+    if (gtmrRespond.isActive() == false)
+    {
+        gtmrRespond.start();
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestScriptedModule::ResetFinished(
+    )
+{
+    //Module is running its application, which asserts CTS
+    gbInDTM = false;
+    gpWindow->gintReplaySignals |= QSerialPort::ClearToSendSignal;
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestScriptedModule::Respond(
+    )
+{
+    //Sends the queued responses in one burst, as a USB adapter would
+    if (gpWindow->SerialIsOpen() == true && gbaResponses.length() > 0)
+    {
+        QByteArray baResponses = gbaResponses;
+        gbaResponses.clear();
+        gpWindow->ProcessSerialData(baResponses.constData(), baResponses.length());
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestVirtualTime::initTestCase(
+    )
+{
+    QVERIFY(gtdSettings.isValid() == true);
+    QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, gtdSettings.path());
+
+    //Timers must be virtual before the window creates any
+    DtmClock::SetVirtual(true);
+    gpWindow = new MainWindow();
+    gpWindow->hide();
+
+    //The module is reached through the replay port without a trace, and runs like a pooled fixture so results
+    //are recorded without message boxes or the application exiting
+    gpWindow->gbReplayActive = true;
+    gpWindow->gintPoolTrigger = PoolTriggerDSR;
+    gpModule = new TestScriptedModule(gpWindow);
+    connect(gpWindow, SIGNAL(EscapeFinished(int)), this, SLOT(EscapeFinished(int)));
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestVirtualTime::cleanupTestCase(
+    )
+{
+    delete gpWindow;
+    DtmClock::SetVirtual(false);
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestVirtualTime::init(
+    )
+{
+    //Default settings for each test
+    gpWindow->ui->check_License->setChecked(true);
+    gpWindow->gintRetryMaxAttempts = DTMRetryDefaultAttempts;
+    gpWindow->gslAllowedFirmware.clear();
+    gpWindow->gslAllowedTypes.clear();
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestVirtualTime::EscapeFinished(
+    int intExitCode
+    )
+{
+    gbFinished = true;
+    gintResult = intExitCode;
+}
+
+//=============================================================================
+//=============================================================================
+int
+TestVirtualTime::Escape(
+    const TestScript &tsScript
+    )
+{
+    //Fits a module, starts the escape and runs the event loop until it has a result
+    gpModule->Reset(tsScript);
+    gpWindow->gbaDisplayBuffer.resize(0);
+    gpWindow->gbaReplayActualTX.resize(0);
+    gbFinished = false;
+    gintResult = 1;
+    qint64 intStart = DtmClock::Now();
+    gpWindow->StartSession();
+    quint32 i = 0;
+    while (gbFinished == false && i < TestMaxEventLoops)
+    {
+        QCoreApplication::processEvents();
+        ++i;
+    }
+    gintElapsed = DtmClock::Now() - intStart;
+    return gintResult;
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestVirtualTime::Escapes(
+    )
+{
+    //Licensed and unlicensed modules, with and without the license check
+    TestScript tsLicensed;
+    TestScript tsUnlicensed;
+    tsUnlicensed.bLicensed = false;
+    quint32 i = 0;
+    while (i < TestEscapeCount)
+    {
+        gpWindow->ui->check_License->setChecked(i % 4 != 3);
+        if (i % 4 == 1)
+        {
+            QCOMPARE(Escape(tsUnlicensed), ExitCodeLicenseMissing);
+        }
+        else
+        {
+            QCOMPARE(Escape(tsLicensed), ExitCodeOK);
+        }
+        QCOMPARE(gpModule->ExitCommands(), (quint8)1);
+        QVERIFY(gintElapsed < (qint64)ModuleTimeout*1000000);
+        QVERIFY(gpWindow->SerialIsOpen() == false);
+        ++i;
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestVirtualTime::Retries(
+    )
+{
+    //Module which misses some exit commands is caught by the resends, one which misses them all times out
+    gpWindow->gintRetryMaxAttempts = 5;
+    TestScript tsScript;
+    quint32 i = 0;
+    while (i < TestTimeoutCount)
+    {
+        tsScript.intIgnoredExits = i % 6;
+        QCOMPARE(Escape(tsScript), ExitCodeOK);
+        QCOMPARE(gpModule->ExitCommands(), (quint8)(tsScript.intIgnoredExits + 1));
+        QCOMPARE(gpWindow->gintExitAttempts, (quint8)(tsScript.intIgnoredExits + 1));
+        ++i;
+    }
+
+    tsScript.intIgnoredExits = TestNeverExit;
+    QCOMPARE(Escape(tsScript), ExitCodeTimeout);
+    QCOMPARE(gpModule->ExitCommands(), (quint8)6);
+    QCOMPARE(gintElapsed, (qint64)ModuleTimeout*1000000);
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestVirtualTime::CTSAsserted(
+    )
+{
+    //CTS cannot be asserted whilst a module is in DTM
+    TestScript tsScript;
+    tsScript.bCTSAtOpen = true;
+    QCOMPARE(Escape(tsScript), ExitCodeCTSAsserted);
+    QCOMPARE(gintElapsed, (qint64)0);
+    QVERIFY(gpWindow->SerialIsOpen() == false);
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestVirtualTime::ExitTimeout(
+    )
+{
+    //Module never leaves DTM
+    TestScript tsScript;
+    tsScript.intIgnoredExits = TestNeverExit;
+    quint32 i = 0;
+    while (i < TestTimeoutCount)
+    {
+        QCOMPARE(Escape(tsScript), ExitCodeTimeout);
+        QCOMPARE(gintElapsed, (qint64)ModuleTimeout*1000000);
+        QCOMPARE(gpWindow->gintProgramState, ProgramStatusIdle);
+        QVERIFY(gpWindow->SerialIsOpen() == false);
+        ++i;
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestVirtualTime::EraseTimeout(
+    )
+{
+    //Module leaves DTM but never confirms the erase
+    TestScript tsScript;
+    tsScript.bAnswerErase = false;
+    quint32 i = 0;
+    while (i < TestTimeoutCount)
+    {
+        QCOMPARE(Escape(tsScript), ExitCodeTimeout);
+        QCOMPARE(gintElapsed, (qint64)ModuleTimeout*1000000);
+        QVERIFY(gpWindow->SerialIsOpen() == false);
+        ++i;
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestVirtualTime::LicenseTimeout(
+    )
+{
+    //Module is erased but never answers the license check
+    TestScript tsScript;
+    tsScript.bAnswerLicense = false;
+    quint32 i = 0;
+    while (i < TestTimeoutCount)
+    {
+        QCOMPARE(Escape(tsScript), ExitCodeTimeout);
+        QCOMPARE(gintElapsed, (qint64)ModuleTimeout*1000000);
+        QVERIFY(gpWindow->SerialIsOpen() == false);
+        ++i;
+    }
+}
+
+//=============================================================================
+//=============================================================================
+void
+TestVirtualTime::IdentifyTimeout(
+    )
+{
+    //An allowed module is erased, a silent one is rejected once the identify timer fires
+    gpWindow->gslAllowedTypes.append("BL65*");
+    TestScript tsScript;
+    QCOMPARE(Escape(tsScript), ExitCodeOK);
+
+    tsScript.bAnswerIdentify = false;
+    quint32 i = 0;
+    while (i < TestTimeoutCount)
+    {
+        QCOMPARE(Escape(tsScript), ExitCodeIdentityMismatch);
+        QVERIFY(gintElapsed >= (qint64)(TestResetTime + IdentifyProbeTimeout)*1000000);
+        QVERIFY(gintElapsed < (qint64)ModuleTimeout*1000000);
+        QVERIFY(gpWindow->gbaReplayActualTX.indexOf("at&f*") == -1);
+        ++i;
+    }
+}
+
+//=============================================================================
+//=============================================================================
+int
+main(
+    int argc,
+    char *argv[]
+    )
+{
+    gtmrProcessStart.start();
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM") == true)
+    {
+        //Run without a display
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication a(argc, argv);
+    TestVirtualTime tvtTest;
+    return QTest::qExec(&tvtTest, argc, argv);
+}
+
+#include "TestVirtualTime.moc"
+
+/******************************************************************************/
+// END OF FILE
+/******************************************************************************/
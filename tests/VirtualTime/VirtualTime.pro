@@ -0,0 +1,11 @@
+QT       += testlib
+
+TARGET = TestVirtualTime
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+#Application sources
+include(../../ExitDTM.pri)
+
+SOURCES += TestVirtualTime.cpp
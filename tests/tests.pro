@@ -0,0 +1,5 @@
+#Unit tests, build with qmake tests/tests.pro and run with make check
+TEMPLATE = subdirs
+
+SUBDIRS += RXAllocation \
+    VirtualTime